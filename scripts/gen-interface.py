@@ -24,6 +24,7 @@ host_comm_header = Header(HOST_COMM_HEADER,
         'USB_CMD',
         'USB_RSP',
         'RETURN_CODE',
+        'HOST_LINK',
         'BREAKPOINT_TYPE',
         'INTERRUPT_SOURCE',
         'ADC_CHAN_INDEX',
@@ -10,8 +10,11 @@
 #include "main_loop.h"
 #include "host_comm.h"
 #include "uart.h"
+#include "dma.h"
 #include "config.h"
 #include "error.h"
+#include "stream.h"
+#include "params.h"
 
 #ifdef CONFIG_SYSTICK
 #include "systick.h"
@@ -48,15 +51,9 @@ static adc_stream_t stream_info[] = {
 
 #define ADC_MAX_CHANNELS  5
 
-#define NUM_BUFFERS                                  2 // double-buffer pair
-#define NUM_BUFFERED_SAMPLES                        32
-
-#define SAMPLE_TIMESTAMPS_SIZE (NUM_BUFFERED_SAMPLES * sizeof(uint32_t))
-#define SAMPLE_VOLTAGES_SIZE   (NUM_BUFFERED_SAMPLES * ADC_MAX_CHANNELS * sizeof(uint16_t))
-
 // Buffer layout:
 //
-//    [ uart msg header | stream msg header |
+//    [ stream msg header |
 //      timestamp 0 | .. | timestamp N |
 //      voltage 0 chan 0 | .. | voltage 0 chan K
 //        ...
@@ -67,112 +64,268 @@ static adc_stream_t stream_info[] = {
 // groupped together was chosen in preparation for DMA, which would have one
 // channel stream timestamps from the timer and another one stream ADC values,
 // both triggered on exact same timer event.
-#define SAMPLES_MSG_BUF_SIZE \
-    (UART_MSG_HEADER_SIZE + STREAM_DATA_MSG_HEADER_LEN + \
-     SAMPLE_TIMESTAMPS_SIZE + SAMPLE_VOLTAGES_SIZE)
-
-#define SAMPLE_TIMESTAMPS_OFFSET  (UART_MSG_HEADER_SIZE + STREAM_DATA_MSG_HEADER_LEN)
-#define SAMPLE_VOLTAGES_OFFSET  (SAMPLE_TIMESTAMPS_OFFSET + SAMPLE_TIMESTAMPS_SIZE)
+//
+// With CONFIG_ADC_DMA, only one DMA channel is left over (the other two carry
+// the host UART), so it streams the ADC values only, and the timestamps are
+// filled in when the buffer is complete: the trigger fires on a fixed period
+// of the timer, which counts in systick ticks (see check below).
+//
+// The buffers form a ring, carved out of a fixed amount of storage when the
+// stream starts: the number of buffers and of samples per buffer are set by
+// PARAM_NUM_ADC_BUFFERS and PARAM_NUM_ADC_SAMPLES_BUFFERED, and the layout
+// must fit in CONFIG_ADC_SAMPLE_RING_SIZE bytes for the requested channels.
+#define SAMPLE_TIMESTAMPS_OFFSET  STREAM_DATA_MSG_HEADER_LEN
 
 static unsigned num_channels;
 
-static uint8_t sample_msg_bufs[NUM_BUFFERS][SAMPLES_MSG_BUF_SIZE];
+// uint16_t for alignment of timestamps and voltages within the buffers
+static uint16_t sample_ring[CONFIG_ADC_SAMPLE_RING_SIZE / sizeof(uint16_t)];
 
-// Can't have a struct type because the number of channels per 'sample' (sequence) varies
-static uint32_t * const sample_timestamps_bufs[NUM_BUFFERS] = {
-    (uint32_t *)&sample_msg_bufs[0][SAMPLE_TIMESTAMPS_OFFSET],
-    (uint32_t *)&sample_msg_bufs[1][SAMPLE_TIMESTAMPS_OFFSET],
-};
-static uint16_t * const sample_voltages_bufs[NUM_BUFFERS] = {
-    (uint16_t *)&sample_msg_bufs[0][SAMPLE_VOLTAGES_OFFSET],
-    (uint16_t *)&sample_msg_bufs[1][SAMPLE_VOLTAGES_OFFSET],
-};
+// Ring layout, fixed for the duration of a stream
+static unsigned num_buffers;
+static unsigned num_buffered_samples;
+static unsigned sample_timestamps_size;
+static unsigned sample_buf_size;
 
-static unsigned num_samples[NUM_BUFFERS];
+static unsigned num_samples[CONFIG_ADC_MAX_BUFFERS];
 static unsigned voltage_sample_offset;
-// volatile because main uses it to get the index of the ready buffer
-static volatile unsigned sample_buf_idx;
+// volatile because main compares it to find the ready buffers
+static volatile unsigned sample_buf_idx; // buffer being filled
+static unsigned send_buf_idx; // oldest buffer not yet handed to the UART
 static uint32_t *sample_timestamps_buf;
 static uint16_t *sample_voltages_buf;
 
-void ADC_start(uint16_t streams, unsigned sampling_period)
+static inline uint8_t *sample_msg_buf(unsigned buf_idx)
+{
+    return (uint8_t *)sample_ring + buf_idx * sample_buf_size;
+}
+
+// Can't have a struct type because the number of channels per 'sample' (sequence) varies
+static inline uint32_t *sample_timestamps_buf_at(unsigned buf_idx)
+{
+    return (uint32_t *)(sample_msg_buf(buf_idx) + SAMPLE_TIMESTAMPS_OFFSET);
+}
+
+static inline uint16_t *sample_voltages_buf_at(unsigned buf_idx)
+{
+    return (uint16_t *)(sample_msg_buf(buf_idx) + SAMPLE_TIMESTAMPS_OFFSET +
+                        sample_timestamps_size);
+}
+
+static inline unsigned next_buf_idx(unsigned buf_idx)
+{
+    return buf_idx + 1 < num_buffers ? buf_idx + 1 : 0;
+}
+
+#ifdef CONFIG_ADC_DMA
+
+#if defined(CONFIG_SYSTICK) && \
+    (!defined(CONFIG_ADC_TIMER_SOURCE_SMCLK) || \
+     CONFIG_TIMELOG_TIMER_SOURCE != TASSEL__SMCLK || \
+     CONFIG_ADC_TIMER_DIV != CONFIG_TIMELOG_TIMER_DIV * CONFIG_TIMELOG_TIMER_DIV_EX)
+#error CONFIG_ADC_DMA: ADC trigger timer must tick at the systick rate
+#endif
+
+#define DMA_TRIG_ADC12IFG 24 // DMAxTSEL for ADC12IFGx (with ADC12IE bit clear)
+
+static bool adc_dma; // whether the current stream is moved by DMA
+static uint32_t dma_first_trigger_time;
+static uint32_t dma_trigger_period;
+static uint32_t dma_sample_seq; // index of the first sample in the current buffer
+
+#ifdef CONFIG_SYSTICK_32BIT
+#define DMA_TIMESTAMP(t) (t)
+#else // !CONFIG_SYSTICK_32BIT
+#define DMA_TIMESTAMP(t) ((t) & 0xffff) // same width as the systick timer
+#endif // !CONFIG_SYSTICK_32BIT
+#endif // CONFIG_ADC_DMA
+
+return_code_t ADC_start(uint16_t streams, unsigned sampling_period)
 {
     unsigned i;
     unsigned offset;
+    unsigned chans;
+    unsigned buf_size;
     uint8_t *header;
     volatile uint8_t *ctl_reg;
 
     LOG("adc: start: streams 0x%04x period %u\r\n", streams, sampling_period);
 
+    chans = 0;
+    for (i = 0; i < ADC_MAX_CHANNELS; ++i) {
+        if (streams & stream_info[i].stream)
+            chans++;
+    }
+
+    // Validate the ring layout before touching the one of a running stream
+    buf_size = STREAM_DATA_MSG_HEADER_LEN +
+               param_num_adc_samples_buffered * sizeof(uint32_t) +
+               param_num_adc_samples_buffered * chans * sizeof(uint16_t);
+    if (chans == 0 ||
+        (uint32_t)buf_size * param_num_adc_buffers > sizeof(sample_ring)) {
+        LOG("adc: start: ring does not fit: %u x %u bytes\r\n",
+            param_num_adc_buffers, buf_size);
+        return RETURN_CODE_INVALID_ARGS;
+    }
+
     ADC12CTL0 &= ~ADC12ENC; // disable conversion so we can set control bits
 
+    num_channels = chans;
+    num_buffers = param_num_adc_buffers;
+    num_buffered_samples = param_num_adc_samples_buffered;
+    sample_timestamps_size = num_buffered_samples * sizeof(uint32_t);
+    sample_buf_size = buf_size;
+
     // sequence of channels, single conversion
     ADC12CTL0 = ADC12SHT0_2 + ADC12ON + ADC12MSC; // sampling time, ADC12 on, multiple sample conversion
 
     // use sampling timer, sequence of channels, repeat-conversion, trigger from Timer B CCR0
     ADC12CTL1 = ADC12SHP + ADC12CONSEQ_1 + ADC12SHS_2;
 
-    // set ADC memory control registers and count channels
-    num_channels = 0;
+    // set ADC memory control registers
     ctl_reg = &ADC12MCTL0;
     for (i = 0; i < ADC_MAX_CHANNELS; ++i) {
-        if (streams & stream_info[i].stream) {
+        if (streams & stream_info[i].stream)
             *(ctl_reg++) = stream_info[i].chan;
-            num_channels++;
-        }
     }
     *(--ctl_reg) |= ADC12EOS;
 
     ADC12IFG = 0; // clear int flags
+
+#ifdef CONFIG_ADC_DMA
+    // A sequence of channels needs the ISR, since DMA triggers on one IFG
+    adc_dma = num_channels == 1;
+    if (adc_dma) {
+        // each trigger converts into MEM0, and the IFG triggers the DMA
+        ADC12CTL0 &= ~ADC12MSC;
+        ADC12CTL1 = ADC12SHP + ADC12CONSEQ_2 + ADC12SHS_2; // repeat single channel
+        ADC12IE = 0; // DMA trigger requires interrupt disabled
+
+        DMA(DMA_ADC, CTL) &= ~DMAEN;
+
+        DMA_CTL(DMA_ADC_CTL) |= DMA_TRIG(DMA_ADC, DMA_TRIG_ADC12IFG);
+
+        DMA(DMA_ADC, CTL) =
+              DMADT_0 /* single */ |
+              DMADSTINCR_3 /* dest inc */ | DMASRCINCR_0 /* src no inc */ |
+              DMAIE;
+
+        DMA(DMA_ADC, SA) = (__DMA_ACCESS_REG__)(&ADC12MEM0);
+        // DMA(DMA_ADC, DA) = set on each buffer
+        // DMA(DMA_ADC, SZ) = set on each buffer
+    } else
+#endif // CONFIG_ADC_DMA
     ADC12IE = (0x0001 << (num_channels - 1)); // enable interupt on last sample
 
     TIMER_CC(TIMER_ADC_TRIGGER, TMRCC_ADC_TRIGGER, CCR) = sampling_period;
     TIMER_CC(TIMER_ADC_TRIGGER, TMRCC_ADC_TRIGGER, CCTL) = OUTMOD_3; // set/reset output mode
+    // cleared, but stopped: started below, with the base time latched
     TIMER(TIMER_ADC_TRIGGER, CTL) =
          TIMER_CLK_SOURCE_BITS(TMRMOD_ADC_TRIGGER, CONFIG_ADC_TIMER_SOURCE_NAME) |
          TIMER_DIV_BITS(CONFIG_ADC_TIMER_DIV) |
-         MC__UP | TIMER_CLR(TMRMOD_ADC_TRIGGER);
+         MC__STOP | TIMER_CLR(TMRMOD_ADC_TRIGGER);
 
-    for (i = 0; i < NUM_BUFFERS; ++i) {
-        header = &sample_msg_bufs[i][UART_MSG_HEADER_SIZE];
+#ifdef CONFIG_ADC_DMA
+    // In up mode, the timer counts 0..CCR0, and the trigger is on reaching
+    // CCR0. Latch the systick time right as the timer starts from zero, so
+    // that sample timestamps do not include the time spent in between.
+#ifdef CONFIG_SYSTICK
+    uint16_t sr = __get_SR_register();
+    __disable_interrupt();
+    dma_first_trigger_time = SYSTICK_CURRENT_TIME + sampling_period;
+    TIMER(TIMER_ADC_TRIGGER, CTL) |= MC__UP;
+    __bis_SR_register(sr & GIE); // restore the caller's interrupt state
+#else // !CONFIG_SYSTICK
+    dma_first_trigger_time = 0;
+    TIMER(TIMER_ADC_TRIGGER, CTL) |= MC__UP;
+#endif // !CONFIG_SYSTICK
+    dma_trigger_period = (uint32_t)sampling_period + 1;
+    dma_sample_seq = 0;
+#else // !CONFIG_ADC_DMA
+    TIMER(TIMER_ADC_TRIGGER, CTL) |= MC__UP;
+#endif // !CONFIG_ADC_DMA
+
+    for (i = 0; i < num_buffers; ++i) {
+        header = sample_msg_buf(i);
         offset = 0;
         header[offset++] = streams;
         header[offset++] = 0; // filled in num events once buffer is ready
+        header[offset++] = 0; // dropped count, set when buffer starts filling
+        header[offset++] = 0;
 
         num_samples[i] = 0;
     }
     voltage_sample_offset = 0;
     sample_buf_idx = 0;
-    sample_timestamps_buf = sample_timestamps_bufs[sample_buf_idx];
-    sample_voltages_buf = sample_voltages_bufs[sample_buf_idx];
+    send_buf_idx = 0;
+    sample_timestamps_buf = sample_timestamps_buf_at(sample_buf_idx);
+    sample_voltages_buf = sample_voltages_buf_at(sample_buf_idx);
+
+#ifdef CONFIG_ADC_DMA
+    if (adc_dma) {
+        stream_write_dropped(STREAM_SOURCE_ADC, sample_msg_buf(sample_buf_idx));
+        DMA(DMA_ADC, DA) = (__DMA_ACCESS_REG__)sample_voltages_buf;
+        DMA(DMA_ADC, SZ) = num_buffered_samples;
+        DMA(DMA_ADC, CTL) |= DMAEN;
+    }
+#endif // CONFIG_ADC_DMA
 
     ADC12CTL0 |= ADC12ENC; // launch: wait for trigger
+    return RETURN_CODE_SUCCESS;
+}
+
+// Hand the current (full) buffer to main loop, if the next one in the ring
+// is free and the host has granted a credit for it
+static bool commit_samples()
+{
+    unsigned next_idx = next_buf_idx(sample_buf_idx);
+
+    if (num_samples[next_idx] != 0 ||
+        !stream_take_credit(STREAM_SOURCE_ADC))
+        return false;
+
+    sample_buf_idx = next_idx;
+    sample_timestamps_buf = sample_timestamps_buf_at(sample_buf_idx);
+    sample_voltages_buf = sample_voltages_buf_at(sample_buf_idx);
+
+    voltage_sample_offset = 0;
+
+    main_loop_flags |= FLAG_ADC_COMPLETE;
+    return true;
+}
+
+static void on_samples_sent(uint8_t *buf)
+{
+    unsigned buf_idx = (buf - (uint8_t *)sample_ring) / sample_buf_size;
+    num_samples[buf_idx] = 0; // mark buffer as free
 }
 
 void ADC_send_samples_to_host()
 {
-    unsigned ready_buf_idx = sample_buf_idx ^ 1; // the other one in the double-buffer pair
+    unsigned ready_buf_idx = send_buf_idx;
+    uint8_t *buf;
 
-    sample_msg_bufs[ready_buf_idx][UART_MSG_HEADER_SIZE + STREAM_DATA_STREAMS_BITMASK_LEN] =
-        num_samples[ready_buf_idx];
+    // Committed buffers are the ones between the send and the fill index
+    if (ready_buf_idx == sample_buf_idx)
+        return;
 
-    UART_begin_transmission();
+    send_buf_idx = next_buf_idx(ready_buf_idx);
+    if (send_buf_idx != sample_buf_idx)
+        main_loop_flags |= FLAG_ADC_COMPLETE; // more are ready, send next pass
+
+    buf = sample_msg_buf(ready_buf_idx);
+    buf[STREAM_DATA_STREAMS_BITMASK_LEN] = num_samples[ready_buf_idx];
 
     // Concatenated timestamps buf and samples buf
-    // sample_buf_idx points to the 'other' (i.e. the ready buf)
     UART_send_msg_to_host(USB_RSP_STREAM_VOLTAGES,
             STREAM_DATA_MSG_HEADER_LEN +
             /* always tx full timestamps section even if buf not completely
              * full because the voltage section is always offset by the
              * size of the timestamp section (i.e. timestamps section is fixed-width,
              * and only the (trailing) voltage section is variable-length). */
-            SAMPLE_TIMESTAMPS_SIZE +
+            sample_timestamps_size +
             num_samples[ready_buf_idx] * sizeof(uint16_t) * num_channels,
-            (uint8_t *)&sample_msg_bufs[ready_buf_idx][0]);
-
-    UART_end_transmission();
-
-    num_samples[ready_buf_idx] = 0; // mark buffer as free
+            buf, on_samples_sent);
 }
 
 void ADC_stop()
@@ -181,8 +334,57 @@ void ADC_stop()
 
     ADC12CTL0 &= ~(ADC12SC | ADC12ENC);  // stop conversion and disable ADC
     while (ADC12CTL1 & ADC12BUSY); // conversion stops at end of sequence
+
+#ifdef CONFIG_ADC_DMA
+    if (adc_dma) {
+        DMA(DMA_ADC, CTL) &= ~DMAEN;
+        adc_dma = false;
+    }
+#endif // CONFIG_ADC_DMA
 }
 
+#ifdef CONFIG_ADC_DMA
+void ADC_dma_complete()
+{
+    unsigned i;
+    unsigned full_buf_idx = sample_buf_idx;
+    uint32_t *timestamps;
+    uint32_t timestamp;
+    bool committed;
+
+    num_samples[full_buf_idx] = num_buffered_samples;
+    committed = commit_samples();
+    if (!committed) // the next buffer may still be on the wire: refill this one
+        num_samples[full_buf_idx] = 0;
+
+    // Re-arm before filling in timestamps, to not miss the next trigger
+    DMA(DMA_ADC, DA) = (__DMA_ACCESS_REG__)sample_voltages_buf;
+    DMA(DMA_ADC, SZ) = num_buffered_samples;
+    DMA(DMA_ADC, CTL) |= DMAEN;
+
+    timestamp = dma_first_trigger_time + dma_sample_seq * dma_trigger_period;
+    dma_sample_seq += num_buffered_samples;
+
+    if (!committed) {
+        // the refilled buffer carries the gap in its header
+        for (i = 0; i < num_buffered_samples; ++i) {
+            stream_drop(STREAM_SOURCE_ADC, DMA_TIMESTAMP(timestamp));
+            timestamp += dma_trigger_period;
+        }
+        stream_write_dropped(STREAM_SOURCE_ADC, sample_msg_buf(sample_buf_idx));
+        return;
+    }
+
+    stream_write_dropped(STREAM_SOURCE_ADC, sample_msg_buf(sample_buf_idx));
+
+    timestamps = sample_timestamps_buf_at(full_buf_idx);
+    for (i = 0; i < num_buffered_samples; ++i) {
+        timestamps[i] = DMA_TIMESTAMP(timestamp);
+        timestamp += dma_trigger_period;
+    }
+}
+#endif // CONFIG_ADC_DMA
+
 #endif // CONFIG_ENABLE_VOLTAGE_STREAM
 
 uint16_t ADC_read(unsigned chan_index)
@@ -219,20 +421,30 @@ void __attribute__ ((interrupt(ADC12_VECTOR))) ADC12_ISR (void)
 #endif
 {
     uint32_t timestamp;
-
-    unsigned current_num_samples = num_samples[sample_buf_idx];
+    unsigned current_num_samples;
 
     uint16_t iv = ADC12IV;
     ADC12IFG = 0; // clear interrupt flags, since ASSERT enables nesting
 
-    ASSERT(ASSERT_ADC_BUFFER_OVERFLOW, current_num_samples < NUM_BUFFERED_SAMPLES);
-
 #ifdef CONFIG_SYSTICK
     timestamp = SYSTICK_CURRENT_TIME;
 #else // !CONFIG_SYSTICK
     timestamp = 0;
 #endif // !CONFIG_SYSTICK
 
+    // Committing a full buffer is retried on every sample
+    if (num_samples[sample_buf_idx] == num_buffered_samples && !commit_samples()) {
+        // the next buffer may still be on the wire: drop the sample, and
+        // keep sampling, the gap is reported in the next frame
+        stream_drop(STREAM_SOURCE_ADC, timestamp);
+        ADC12CTL0 |= ADC12ENC;
+        return;
+    }
+
+    current_num_samples = num_samples[sample_buf_idx];
+    if (current_num_samples == 0)
+        stream_write_dropped(STREAM_SOURCE_ADC, sample_msg_buf(sample_buf_idx));
+
     sample_timestamps_buf[current_num_samples] = timestamp;
 
     switch(__even_in_range(iv,34))
@@ -281,17 +493,9 @@ void __attribute__ ((interrupt(ADC12_VECTOR))) ADC12_ISR (void)
             ASSERT(ASSERT_UNEXPECTED_INTERRUPT, false);
     }
 
-    // If buffer is full, then swap to the other buffer in the double-buffer pair
-    if (++(num_samples[sample_buf_idx]) == NUM_BUFFERED_SAMPLES) {
-
-        sample_buf_idx ^= 1;
-        sample_timestamps_buf = sample_timestamps_bufs[sample_buf_idx];
-        sample_voltages_buf = sample_voltages_bufs[sample_buf_idx];
-
-        voltage_sample_offset = 0;
-
-        main_loop_flags |= FLAG_ADC_COMPLETE;
-    }
+    // If buffer is full, then move on to the next buffer in the ring
+    if (++(num_samples[sample_buf_idx]) == num_buffered_samples)
+        commit_samples();
 
     ADC12CTL0 |= ADC12ENC;
 }
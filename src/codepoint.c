@@ -17,6 +17,12 @@
 #include "main_loop.h"
 #include "tether.h"
 #include "params.h"
+#include "stream.h"
+#include "target_xact.h"
+
+#ifdef CONFIG_PERIODIC_PAYLOAD
+#include "payload.h"
+#endif
 
 #include "codepoint.h"
 
@@ -48,27 +54,11 @@ static watchpoint_callback_t *watchpoint_callback = NULL;
 
 #define NUM_WATCHPOINT_BUFFERS 2
 
-#define WATCHPOINT_EVENT_BUF_HEADER_SPACE 1 // units of sizeof(watchpoint_event_t)
-#define WATCHPOINT_EVENT_BUF_PAYLOAD_SPACE MAX_WATCHPOINT_EVENTS_BUFFERED // units of sizeof(watchpoint_event_t)
-#define WATCHPOINT_EVENT_BUF_SIZE \
-    (WATCHPOINT_EVENT_BUF_HEADER_SPACE + WATCHPOINT_EVENT_BUF_PAYLOAD_SPACE) // units of sizeof(watchpoint_event_t)
-
-#if STREAM_DATA_MSG_HEADER > WATCHPOINT_EVENT_BUF_HEADER_SPACE
-#error Not enough space for header in event buf: add more units of sizeof(struct watchpoint_event_t)
-#endif
-
-#define WATCHPOINT_EVENT_BUF_HEADER_OFFSET \
-    (WATCHPOINT_EVENT_BUF_HEADER_SPACE * sizeof(watchpoint_event_t) - \
-        (UART_MSG_HEADER_SIZE + STREAM_DATA_MSG_HEADER_LEN))
-
 #ifdef CONFIG_ENABLE_WATCHPOINT_STREAM
+// Header and events are gathered into one message when sent
+static uint8_t watchpoint_events_headers[NUM_WATCHPOINT_BUFFERS][STREAM_DATA_MSG_HEADER_LEN];
 static watchpoint_event_t
-watchpoint_events_msg_bufs[NUM_WATCHPOINT_BUFFERS][WATCHPOINT_EVENT_BUF_SIZE];
-
-static watchpoint_event_t *watchpoint_events_bufs[NUM_WATCHPOINT_BUFFERS] = {
-    &watchpoint_events_msg_bufs[0][WATCHPOINT_EVENT_BUF_HEADER_SPACE],
-    &watchpoint_events_msg_bufs[1][WATCHPOINT_EVENT_BUF_HEADER_SPACE]
-};
+watchpoint_events_bufs[NUM_WATCHPOINT_BUFFERS][MAX_WATCHPOINT_EVENTS_BUFFERED];
 
 static unsigned watchpoint_events_count[NUM_WATCHPOINT_BUFFERS];
 static watchpoint_event_t *watchpoint_events_buf;
@@ -84,6 +74,11 @@ void set_external_breakpoint_pin_state(uint16_t bitmask, bool state)
         GPIO(PORT_CODEPOINT, OUT) &= ~(bitmask << PIN_CODEPOINT_0);
 }
 
+static void on_target_breakpoint_rsp(uartPkt_t *rsp, unsigned arg)
+{
+    send_return_code(rsp ? RETURN_CODE_SUCCESS : RETURN_CODE_COMM_ERROR);
+}
+
 unsigned toggle_breakpoint(breakpoint_type_t type, unsigned index,
                               uint16_t energy_level, comparator_ref_t cmp_ref,
                               bool enable)
@@ -140,10 +135,10 @@ unsigned toggle_breakpoint(breakpoint_type_t type, unsigned index,
             else
                 internal_breakpoints &= ~(1 << index);
 
+            target_xact_begin(WISP_RSP_BREAKPOINT, CONFIG_TARGET_XACT_TIMEOUT,
+                              on_target_breakpoint_rsp, 0);
             target_comm_send_breakpoint(index, enable);
-            while((UART_buildRxPkt(UART_INTERFACE_WISP, &wispRxPkt) != 0) ||
-                    (wispRxPkt.descriptor != WISP_RSP_BREAKPOINT)); // wait for response
-            wispRxPkt.processed = 1;
+            rc = RETURN_CODE_NONE; // return code is sent once the target acks
             break;
 
         case BREAKPOINT_TYPE_EXTERNAL:
@@ -271,6 +266,18 @@ static void swap_buffers()
     main_loop_flags |= FLAG_WATCHPOINT_READY;
 }
 
+// Hand the current (full) buffer to main loop, if the other one is free
+// and the host has granted a credit for it
+static bool commit_watchpoint_events()
+{
+    if (watchpoint_events_count[watchpoint_events_buf_idx ^ 1] != 0 ||
+        !stream_take_credit(STREAM_SOURCE_WATCHPOINTS))
+        return false;
+
+    swap_buffers();
+    return true;
+}
+
 void init_watchpoint_event_bufs()
 {
     unsigned i, offset;
@@ -282,11 +289,13 @@ void init_watchpoint_event_bufs()
     for (i = 0; i < NUM_WATCHPOINT_BUFFERS; ++i) {
         watchpoint_events_count[i] = 0;
 
-        header = (uint8_t *)&watchpoint_events_msg_bufs[i][0] +
-                    UART_MSG_HEADER_SIZE + WATCHPOINT_EVENT_BUF_HEADER_OFFSET;
+        header = &watchpoint_events_headers[i][0];
         offset = 0;
         header[offset++] = STREAM_WATCHPOINTS;
         header[offset++] = 0; // padding
+        header[offset++] = 0; // dropped count, set when buffer starts filling
+        header[offset++] = 0;
+        offset += STREAM_DATA_GAP_LEN; // gap range, set with dropped count
         ASSERT(ASSERT_INVALID_STREAM_BUF_HEADER, offset == STREAM_DATA_MSG_HEADER_LEN);
 
         // Just for easier diagnostics of problems in the data stream
@@ -299,43 +308,53 @@ void init_watchpoint_event_bufs()
 
 static void append_watchpoint_event(unsigned index)
 {
-    if (watchpoint_events_count[watchpoint_events_buf_idx] <
-            param_num_watchpoint_events_buffered) {
+    watchpoint_event_t *watchpoint_event;
 
-        watchpoint_event_t *watchpoint_event =
-            &watchpoint_events_buf[watchpoint_events_count[watchpoint_events_buf_idx]++];
+    // Committing a full buffer is retried on every event
+    if (watchpoint_events_count[watchpoint_events_buf_idx] ==
+            param_num_watchpoint_events_buffered &&
+        !commit_watchpoint_events()) {
+        // both buffers are full or out of credits: indicate error on LED
+        GPIO(PORT_LED, OUT) |= BIT(PIN_LED_RED);
+
+        // drop the watchpoint on the floor, but count it
+        stream_drop(STREAM_SOURCE_WATCHPOINTS, SYSTICK_CURRENT_TIME);
+        return;
+    }
 
-        watchpoint_event->timestamp = SYSTICK_CURRENT_TIME;
-        watchpoint_event->index = index;
-        if (watchpoints_vcap_snapshot & (1 << index))
-            watchpoint_event->vcap = ADC_read(ADC_CHAN_INDEX_VCAP);
-        else // TODO: don't stream vcap at all if snapshot is not enabled
-            watchpoint_event->vcap = 0;
+    // clear error indicator
+    GPIO(PORT_LED, OUT) &= ~BIT(PIN_LED_RED);
 
-    }
+    if (watchpoint_events_count[watchpoint_events_buf_idx] == 0)
+        stream_write_dropped(STREAM_SOURCE_WATCHPOINTS,
+                             &watchpoint_events_headers[watchpoint_events_buf_idx][0]);
+
+    watchpoint_event =
+        &watchpoint_events_buf[watchpoint_events_count[watchpoint_events_buf_idx]++];
+
+    watchpoint_event->timestamp = SYSTICK_CURRENT_TIME;
+    watchpoint_event->index = index;
+    if (watchpoints_vcap_snapshot & (1 << index))
+        watchpoint_event->vcap = ADC_read(ADC_CHAN_INDEX_VCAP);
+    else // TODO: don't stream vcap at all if snapshot is not enabled
+        watchpoint_event->vcap = 0;
 
     if (watchpoint_events_count[watchpoint_events_buf_idx] ==
-            param_num_watchpoint_events_buffered) {// buffer full
-        if (!(main_loop_flags & FLAG_WATCHPOINT_READY)) { // the other buffer is free
-            swap_buffers();
-            // clear error indicator
-            GPIO(PORT_LED, OUT) &= ~BIT(PIN_LED_RED);
-        } else { // both buffers are full
-            // indicate error on LED
-            GPIO(PORT_LED, OUT) |= BIT(PIN_LED_RED);
-
-            // drop the watchpoints on the floor
-        }
-    } else {
-        // clear error indicator
-        GPIO(PORT_LED, OUT) &= ~BIT(PIN_LED_RED);
-    }
+            param_num_watchpoint_events_buffered) // buffer full
+        commit_watchpoint_events();
+}
+
+static void on_watchpoint_events_sent(uint8_t *buf)
+{
+    unsigned buf_idx = (buf == &watchpoint_events_headers[0][0]) ? 0 : 1;
+    watchpoint_events_count[buf_idx] = 0; // mark buffer as free
 }
 
 void send_watchpoint_events()
 {
     unsigned ready_events_count;
     unsigned ready_events_buf_idx = watchpoint_events_buf_idx ^ 1; // the other one in the pair
+    uart_segment_t segments[2];
 
     ready_events_count = watchpoint_events_count[ready_events_buf_idx];
 
@@ -344,17 +363,14 @@ void send_watchpoint_events()
     // fairly close to each other).
     //LOG("wpts: send buf %u cnt %u\r\n", ready_events_buf_idx, ready_events_count);
 
-    UART_begin_transmission();
+    // Buffer is marked as free once the transfer completes
+    segments[0].buf = &watchpoint_events_headers[ready_events_buf_idx][0];
+    segments[0].len = STREAM_DATA_MSG_HEADER_LEN;
+    segments[1].buf = (uint8_t *)&watchpoint_events_bufs[ready_events_buf_idx][0];
+    segments[1].len = ready_events_count * sizeof(watchpoint_event_t);
 
-    // Must use a blocking call in order to mark buffer as free once transfer completes
-    UART_send_msg_to_host(USB_RSP_STREAM_EVENTS,
-            STREAM_DATA_MSG_HEADER_LEN + ready_events_count * sizeof(watchpoint_event_t),
-            (uint8_t *)&watchpoint_events_msg_bufs[ready_events_buf_idx][0] +
-            WATCHPOINT_EVENT_BUF_HEADER_OFFSET);
-
-    UART_end_transmission();
-
-    watchpoint_events_count[ready_events_buf_idx] = 0; // mark buffer as free
+    UART_send_segments_to_host(USB_RSP_STREAM_EVENTS, segments, 2,
+                               on_watchpoint_events_sent);
 }
 #endif // CONFIG_ENABLE_WATCHPOINT_STREAM
 
@@ -418,6 +434,9 @@ void handle_codepoint(unsigned index)
 #endif // CONFIG_ENABLE_WATCHPOINT_CALLBACK
 #ifdef CONFIG_ENABLE_WATCHPOINT_STREAM
             append_watchpoint_event(index);
+#endif
+#ifdef CONFIG_PERIODIC_PAYLOAD
+            payload_record_watchpoint(index);
 #endif
         }
 
@@ -15,8 +15,16 @@
 //#define CONFIG_TARGET_UART_BAUDRATE 9600ull
 #define CONFIG_TARGET_UART_BAUDRATE 115200ull
 
+// Max rate the target link may be switched to at runtime, and the byte
+// sent in the serial echo that probes the new rate
+#define CONFIG_TARGET_UART_MAX_BAUDRATE 1000000ull
+#define CONFIG_TARGET_BAUDRATE_PROBE_VALUE 0xA5
+
 // #define CONFIG_USB_UART_UCOS16
-// #define CONFIG_TARGET_UART_UCOS16
+#define CONFIG_TARGET_UART_UCOS16 // as in the divisor tables for 115200 at 24 MHz
+
+// Max error of the average bit rate given by the UART divisors
+#define CONFIG_UART_MAX_BAUD_ERROR_PPM 20000
 
 // #define CONFIG_TIMELOG_TIMER_SOURCE TASSEL__ACLK
 #define CONFIG_TIMELOG_TIMER_SOURCE TASSEL__SMCLK
@@ -48,8 +56,65 @@
 
 #define CONFIG_ADC_TIMER_FREQ (CONFIG_ADC_TIMER_CLK_FREQ / CONFIG_ADC_TIMER_DIV)
 
+// Storage for the voltage stream sample ring, split into buffers at stream
+// start (see PARAM_NUM_ADC_BUFFERS, PARAM_NUM_ADC_SAMPLES_BUFFERED). Default
+// fits two buffers of 32 samples of all 5 channels (12 + 32 * (4 + 5 * 2)).
+#define CONFIG_ADC_SAMPLE_RING_SIZE 920
+#define CONFIG_ADC_MAX_BUFFERS 8
+
 // Intervals for schedulable actions: time source fixed at ACLK
 #define CONFIG_ENTER_DEBUG_MODE_TIMEOUT   0xff
 #define CONFIG_EXIT_DEBUG_MODE_TIMEOUT    0xff
+#define CONFIG_HOST_BAUDRATE_PROBE_TIMEOUT 0x1000
+
+// Time to wait for the response to a request to target (ms): runs on the
+// systick timer (see TIMER_XACT), not the sched timer
+#define CONFIG_TARGET_XACT_TIMEOUT        250
+
+// Memory dump: bytes per read request to target, per message to host, and
+// in a dump (a dump holds the target link until it completes or times out)
+#define CONFIG_DUMP_MEM_CHUNK_LEN         32
+#define CONFIG_DUMP_MEM_FRAME_DATA_LEN    224
+#define CONFIG_DUMP_MEM_MAX_LEN           0x10000
+
+// Memory CRC: max block CRCs per message to host (chunks as for memory dump)
+#define CONFIG_CRC_MEM_FRAME_BLOCKS       64
+
+// Bulk memory write: bytes staged from host before writing, requests to
+// target in flight (the target must buffer as many), and bytes per read
+// request when verifying the written range
+#define CONFIG_MEM_WRITE_STAGING_LEN      512
+#define CONFIG_MEM_WRITE_PIPELINE_DEPTH   2
+#define CONFIG_MEM_WRITE_VERIFY_CHUNK_LEN 48
+
+// Gather read: max ranges in a host command, and max bytes in the reply
+#define CONFIG_GATHER_MAX_RANGES          12
+#define CONFIG_GATHER_MAX_LEN             128
+
+// Max bytes of target memory sent with the extended interrupt context
+#define CONFIG_CONTEXT_WINDOW_MAX_LEN     32
+
+// Coalesced target STDIO: bytes per message to host, and max age (in systick
+// ticks, up to 0xffff) of the oldest bytes before they are sent
+#define CONFIG_TARGET_STDIO_FRAME_LEN     192
+#define CONFIG_TARGET_STDIO_FLUSH_AGE     0x8000
+
+// Periodic payload: systick ticks between Vcap samples, and bytes of the
+// latest app output kept in a record
+#define CONFIG_PAYLOAD_ENERGY_SAMPLE_TICKS 0x10000
+#define CONFIG_PAYLOAD_APP_OUTPUT_LEN     16
+
+// Target memory read cache: lines of bytes, and max bytes read to fill lines
+#define CONFIG_MEM_CACHE_LINES            4
+#define CONFIG_MEM_CACHE_LINE_LEN         16
+#define CONFIG_MEM_CACHE_FILL_LEN         48
+#define CONFIG_MEM_CACHE_MIN_ADDRESS      0x1000 // below are peripheral registers
+
+// Debug mode snapshots: regions, bytes per block (per read request to target),
+// blocks per region, and max bytes of blocks per message to host
+#define CONFIG_SNAPSHOT_REGIONS           2
+#define CONFIG_SNAPSHOT_BLOCK_LEN         32
+#define CONFIG_SNAPSHOT_MAX_BLOCKS        32
+#define CONFIG_SNAPSHOT_FRAME_DATA_LEN    192
 
 #endif // CONFIG_H
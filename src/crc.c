@@ -0,0 +1,16 @@
+#include <stdint.h>
+
+#include "crc.h"
+
+uint16_t crc16_update(uint16_t crc, const uint8_t *buf, unsigned len)
+{
+    uint8_t x;
+
+    // Byte-at-a-time without a table: folds the eight shift-xor steps
+    while (len--) {
+        x = (crc >> 8) ^ *buf++;
+        x ^= x >> 4;
+        crc = (crc << 8) ^ ((uint16_t)x << 12) ^ ((uint16_t)x << 5) ^ x;
+    }
+    return crc;
+}
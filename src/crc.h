@@ -0,0 +1,17 @@
+#ifndef CRC_H
+#define CRC_H
+
+#include <stdint.h>
+
+#define CRC16_INIT 0xFFFF
+
+/**
+ * @brief   Update a CRC-16-CCITT over an array of bytes
+ * @param   crc     CRC so far (CRC16_INIT to start a new one)
+ * @param   buf     Bytes to add to the CRC
+ * @param   len     Number of bytes
+ * @details Polynomial 0x1021, MSB first, no final XOR (a.k.a. CCITT-FALSE).
+ */
+uint16_t crc16_update(uint16_t crc, const uint8_t *buf, unsigned len);
+
+#endif // CRC_H
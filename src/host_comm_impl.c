@@ -13,34 +13,66 @@
 #include "params.h"
 #include "host_comm.h"
 
+#ifdef CONFIG_TARGET_MEM_CACHE
+#include "mem_cache.h"
+#endif
+
 #include "host_comm_impl.h"
 
 /**
- * @brief Message payload pointer in a buffer for messages to host
- * @details This buffer is used exclusively by main loop, so it is
- *          shared only in the sense of being multi-plexed in time, i.e. it is
- *          never used concurrently but to threads of control.
+ * @brief Pool of buffers for messages to host
+ * @details The buffers are filled exclusively by the main loop, one at a
+ *          time, but several may be queued for transmission at once. A buffer
+ *          is released by the TX completion callback (from the DMA ISR).
  */
-static uint8_t host_msg_buf[HOST_MSG_BUF_SIZE];
-static uint8_t * const host_msg_payload = &host_msg_buf[UART_MSG_HEADER_SIZE];
+static uint8_t host_msg_bufs[HOST_MSG_BUF_COUNT][HOST_MSG_BUF_SIZE];
+static volatile unsigned host_msg_bufs_busy = 0; // bitmask
+
+static uint8_t *host_msg_payload;   // buffer being filled by main loop
+
+/**
+ * @brief Return codes of the commands in the batch being executed
+ * @details While a batch is executed, return codes are collected here and
+ *          sent in one reply at the end. Other replies are sent as usual.
+ */
+static bool batch_active = false;
+static unsigned batch_count;
+static uint8_t batch_codes[HOST_BATCH_MAX_CMDS];
+
+static void on_host_msg_sent(uint8_t *buf)
+{
+    unsigned idx = (buf - &host_msg_bufs[0][0]) / HOST_MSG_BUF_SIZE;
+    host_msg_bufs_busy &= ~(1 << idx);
+}
+
+// Grab a free buffer from the pool, waiting for one if all are queued
+static void begin_msg_to_host()
+{
+    unsigned idx = 0;
+
+    while (host_msg_bufs_busy & (1 << idx))
+        idx = (idx + 1) % HOST_MSG_BUF_COUNT;
 
-// Uses the main loop host_msg_buf
+    host_msg_bufs_busy |= 1 << idx;
+    host_msg_payload = &host_msg_bufs[idx][0];
+}
+
+// Uses the main loop host_msg_payload
 static inline void send_msg_to_host(unsigned descriptor, unsigned payload_len)
 {
     // Out-of-bound writes already happen before we get here, but the payload
     // len should be in a register and this is not a function call (inline), so
     // this check should be robust even if memory got a little corrupted.
-    ASSERT(ASSERT_HOST_MSG_BUF_OVERFLOW, payload_len <= HOST_MSG_BUF_SIZE - UART_MSG_HEADER_SIZE);
+    ASSERT(ASSERT_HOST_MSG_BUF_OVERFLOW, payload_len <= HOST_MSG_BUF_SIZE);
 
-    UART_send_msg_to_host(descriptor, payload_len, host_msg_buf);
-    UART_end_transmission();
+    UART_send_msg_to_host(descriptor, payload_len, host_msg_payload, on_host_msg_sent);
 }
 
 void send_voltage(uint16_t voltage)
 {
     unsigned payload_len = 0;
 
-    UART_begin_transmission();
+    begin_msg_to_host();
 
     host_msg_payload[payload_len++] = voltage & 0xFF;
     host_msg_payload[payload_len++] = (voltage >> 8) & 0xFF;
@@ -51,7 +83,13 @@ void send_voltage(uint16_t voltage)
 void send_return_code(unsigned code)
 {
     unsigned payload_len = 0;
-    UART_begin_transmission();
+
+    if (batch_active && batch_count > 0) {
+        batch_codes[batch_count - 1] = code;
+        return;
+    }
+
+    begin_msg_to_host();
     host_msg_payload[payload_len++] = code;
     send_msg_to_host(USB_RSP_RETURN_CODE, payload_len);
 }
@@ -60,7 +98,7 @@ void send_interrupt_context(interrupt_context_t *int_context)
 {
     unsigned payload_len = 0;
 
-    UART_begin_transmission();
+    begin_msg_to_host();
 
     host_msg_payload[payload_len++] = int_context->type;
     host_msg_payload[payload_len++] = int_context->id;
@@ -71,10 +109,46 @@ void send_interrupt_context(interrupt_context_t *int_context)
     send_msg_to_host(USB_RSP_INTERRUPTED, payload_len);
 }
 
+#ifdef CONFIG_RICH_INTERRUPT_CONTEXT
+#if 15 + CONFIG_CONTEXT_WINDOW_MAX_LEN > HOST_MSG_BUF_SIZE || \
+    CONFIG_CONTEXT_WINDOW_MAX_LEN > UART_PKT_MAX_DATA_LEN
+#error Context window does not fit in a message: CONFIG_CONTEXT_WINDOW_MAX_LEN
+#endif
+
+void send_interrupt_context_ext(interrupt_context_t *int_context, uint32_t pc,
+                                uint32_t window_address, uint8_t *window, unsigned window_len)
+{
+    unsigned payload_len = 0;
+
+    begin_msg_to_host();
+
+    host_msg_payload[payload_len++] = int_context->type;
+    host_msg_payload[payload_len++] = int_context->id;
+    host_msg_payload[payload_len++] = int_context->id >> 8;
+    host_msg_payload[payload_len++] = (int_context->saved_vcap >> 0) & 0xff;
+    host_msg_payload[payload_len++] = (int_context->saved_vcap >> 8) & 0xff;
+    host_msg_payload[payload_len++] = (int_context->restored_vcap >> 0) & 0xff;
+    host_msg_payload[payload_len++] = (int_context->restored_vcap >> 8) & 0xff;
+    host_msg_payload[payload_len++] = (pc >> 0) & 0xff;
+    host_msg_payload[payload_len++] = (pc >> 8) & 0xff;
+    host_msg_payload[payload_len++] = (pc >> 16) & 0xff;
+    host_msg_payload[payload_len++] = (pc >> 24) & 0xff;
+    host_msg_payload[payload_len++] = (window_address >> 0) & 0xff;
+    host_msg_payload[payload_len++] = (window_address >> 8) & 0xff;
+    host_msg_payload[payload_len++] = (window_address >> 16) & 0xff;
+    host_msg_payload[payload_len++] = (window_address >> 24) & 0xff;
+
+    memcpy(&host_msg_payload[payload_len], window, window_len);
+    payload_len += window_len;
+
+    send_msg_to_host(USB_RSP_INTERRUPT_CONTEXT_EXT, payload_len);
+}
+#endif // CONFIG_RICH_INTERRUPT_CONTEXT
+
 void send_param(param_t param)
 {
     unsigned payload_len = 0;
-    UART_begin_transmission();
+    begin_msg_to_host();
 
     host_msg_payload[payload_len++] = param & 0xff;
     host_msg_payload[payload_len++] = (param >> 8) & 0xff;
@@ -87,7 +161,7 @@ void send_param(param_t param)
 void send_echo(uint8_t value)
 {
     unsigned payload_len = 0;
-    UART_begin_transmission();
+    begin_msg_to_host();
     host_msg_payload[payload_len++] = value;
     send_msg_to_host(USB_RSP_ECHO, payload_len);
 }
@@ -96,7 +170,7 @@ void forward_msg_to_host(unsigned descriptor, uint8_t *buf, unsigned len)
 {
     unsigned payload_len = 0;
 
-    UART_begin_transmission();
+    begin_msg_to_host();
 
     while (len--) {
         host_msg_payload[payload_len] = buf[payload_len];
@@ -105,3 +179,67 @@ void forward_msg_to_host(unsigned descriptor, uint8_t *buf, unsigned len)
 
     send_msg_to_host(descriptor, payload_len);
 }
+
+void send_host_link_stats()
+{
+    unsigned payload_len = 0;
+
+    begin_msg_to_host();
+
+    host_msg_payload[payload_len++] = host_link_stats.rx_msgs & 0xff;
+    host_msg_payload[payload_len++] = host_link_stats.rx_msgs >> 8;
+    host_msg_payload[payload_len++] = host_link_stats.crc_errors & 0xff;
+    host_msg_payload[payload_len++] = host_link_stats.crc_errors >> 8;
+    host_msg_payload[payload_len++] = host_link_stats.framing_errors & 0xff;
+    host_msg_payload[payload_len++] = host_link_stats.framing_errors >> 8;
+    host_msg_payload[payload_len++] = host_link_stats.resyncs & 0xff;
+    host_msg_payload[payload_len++] = host_link_stats.resyncs >> 8;
+    host_msg_payload[payload_len++] = host_link_stats.rx_overruns & 0xff;
+    host_msg_payload[payload_len++] = host_link_stats.rx_overruns >> 8;
+
+    send_msg_to_host(USB_RSP_HOST_LINK_STATS, payload_len);
+}
+
+#ifdef CONFIG_TARGET_MEM_CACHE
+void send_mem_cache_stats()
+{
+    unsigned payload_len = 0;
+
+    begin_msg_to_host();
+
+    host_msg_payload[payload_len++] = mem_cache_stats.hits & 0xff;
+    host_msg_payload[payload_len++] = mem_cache_stats.hits >> 8;
+    host_msg_payload[payload_len++] = mem_cache_stats.misses & 0xff;
+    host_msg_payload[payload_len++] = mem_cache_stats.misses >> 8;
+
+    send_msg_to_host(USB_RSP_MEM_CACHE_STATS, payload_len);
+}
+#endif // CONFIG_TARGET_MEM_CACHE
+
+void begin_batch()
+{
+    batch_active = true;
+    batch_count = 0;
+}
+
+void begin_batch_cmd()
+{
+    ASSERT(ASSERT_HOST_MSG_BUF_OVERFLOW, batch_count < HOST_BATCH_MAX_CMDS);
+    batch_codes[batch_count++] = RETURN_CODE_NONE;
+}
+
+void end_batch()
+{
+    unsigned payload_len = 0;
+    unsigned i;
+
+    batch_active = false;
+
+    begin_msg_to_host();
+
+    host_msg_payload[payload_len++] = batch_count;
+    for (i = 0; i < batch_count; ++i)
+        host_msg_payload[payload_len++] = batch_codes[i];
+
+    send_msg_to_host(USB_RSP_BATCH, payload_len);
+}
@@ -4,6 +4,8 @@
 #include <stdint.h>
 #include <msp430.h>
 
+#include "host_comm.h"
+
 /**
  * @defgroup    ADC12   ADC12
  * @brief       Usage of the 12-bit ADC
@@ -13,8 +15,10 @@
 /**
  * @brief       Configure the 12-bit ADC
  * @param       streams Bitmask of which channels to sample (see stream_t in host_comm.h)
+ * @return      RETURN_CODE_INVALID_ARGS if the sample ring set by the params
+ *              does not fit in the buffer storage for these channels
  */
-void ADC_start(uint16_t streams, unsigned sampling_period);
+return_code_t ADC_start(uint16_t streams, unsigned sampling_period);
 
 /**
  * @brief       Stop the ADC conversion and disable the ADC
@@ -33,10 +37,20 @@ uint16_t ADC_read(unsigned chan_index);
 /**
  * @brief   Send buffered samples to host via UART
  * @details Called by main when the ADC module notifies it that a buffer in the
- *          double-buffer pair has been filled and is ready for transmission.
+ *          sample ring has been filled and is ready for transmission. Sends
+ *          the oldest ready buffer, and re-raises the flag if more are ready.
  */
 void ADC_send_samples_to_host();
 
+#ifdef CONFIG_ADC_DMA
+/**
+ * @brief   Handle completion of the DMA transfer of a buffer of samples
+ * @details Called from the DMA ISR when the DMA channel has filled the
+ *          voltage section of the current buffer (single-channel streams).
+ */
+void ADC_dma_complete();
+#endif // CONFIG_ADC_DMA
+
 /** @} end ADC12 */
 
 #endif // ADC_H
@@ -40,6 +40,7 @@ typedef enum {
     ASSERT_SCHED_ACTION_MISMATCH                  = 17,
     ASSERT_NESTED_SCHED_ACTION                    = 18,
     ASSERT_INVALID_PARAM                          = 19,
+    ASSERT_TARGET_XACT_BUSY                       = 20, // request chained while another is pending
 } assert_t;
 
 /* @brief Blink led at a given rate indefinitely
@@ -12,7 +12,55 @@
  *              | 0                    | UART identifier       | Identifies the source of the message   |
  *              | 1                    | Message descriptor    | Identifies the message                 |
  *              | 2                    | Length                | Length of the upcoming data            |
- *              | 3 to (2 + length)    | Data                  | Message data (optional)                |
+ *              | 3                    | Sequence ID           | Echoed in the reply (host link only)   |
+ *              | 4 to (3 + length)    | Data                  | Message data (optional)                |
+ *
+ *              On the host link, the host tags each command with a sequence
+ *              ID and the debugger copies it into the reply(ies) to that
+ *              command, including replies sent later (e.g. the context sent
+ *              on entering debug mode). Unsolicited messages (streams,
+ *              target-initiated interrupts) carry zero. The host may keep
+ *              several commands in flight, up to UART_HOST_RX_RING_SIZE
+ *              bytes in total; they are executed in order. On the target
+ *              link, this byte tags a request, for the target to echo in
+ *              its response (see target_msg_tag).
+ *
+ *              A bulk memory write (USB_CMD_WRITE_MEM_BULK) may span several
+ *              commands, the rest of the bytes following in order in
+ *              USB_CMD_WRITE_MEM_BULK_DATA commands. Only the command that
+ *              completes the block is replied to, with the return code of
+ *              the whole transfer, unless a command is rejected.
+ *
+ *              The host may switch the link rate with USB_CMD_SET_BAUDRATE:
+ *              the reply is sent at the old rate, then the debugger switches
+ *              and waits for a USB_CMD_BAUDRATE_PROBE at the new rate. If no
+ *              probe arrives in time (CONFIG_HOST_BAUDRATE_PROBE_TIMEOUT),
+ *              the debugger falls back to the old rate; the host should do
+ *              the same if it gets no echo of the probe.
+ *
+ *              With the extended header (see HOST_LINK_EXT_LEN), used in
+ *              both directions on the host link, the length is 16-bit:\n
+ *              | Byte                 | Name                  | Description                            |
+ *              | -------------------- | --------------------- | -------------------------------------- |
+ *              | 0                    | UART identifier       | Identifies the source of the message   |
+ *              | 1                    | Message descriptor    | Identifies the message                 |
+ *              | 2                    | Length (LSB)          | Length of the upcoming data            |
+ *              | 3                    | Sequence ID           | Echoed in the reply                    |
+ *              | 4                    | Length (MSB)          |                                        |
+ *              | 5                    | Padding               | Keeps the data aligned                 |
+ *              | 6 to (5 + length)    | Data                  | Message data (optional)                |
+ *
+ *              Messages from the host may be up to UART_HOST_RX_MSG_MAX_LEN
+ *              bytes long (header included), with either header; others
+ *              are dropped.
+ *
+ *              In framed mode (see HOST_LINK_FRAMED), each message is
+ *              followed by a CRC-16-CCITT (init 0xFFFF, little-endian) over
+ *              the whole message, then the message and CRC are COBS-encoded
+ *              and terminated by a zero byte. A receiver that loses sync
+ *              drops bytes up to the next zero byte. The host switches the
+ *              mode with USB_CMD_SET_HOST_LINK: the reply to this command
+ *              is still in the old mode.
  *
  * @{
  */
@@ -69,7 +117,22 @@ typedef enum {
     USB_CMD_WATCHPOINT                      = 0x43, //!< enable/disable a watchpoint
     USB_CMD_SET_PARAM                       = 0x44, //!< set a parameter value
     USB_CMD_GET_PARAM                       = 0x45, //!< get a parameter value
-    USB_CMD_PERIODIC_PAYLOAD                = 0x46, //!< enable periodic sending of EDB+App data
+    USB_CMD_PERIODIC_PAYLOAD                = 0x46, //!< enable periodic sending of EDB+App data: period (uint32, systick ticks, 0 = off)
+    USB_CMD_SET_HOST_LINK                   = 0x47, //!< set host link options (bitmask of host_link_flag_t)
+    USB_CMD_GET_HOST_LINK_STATS             = 0x48, //!< get counters of received messages and link errors
+    USB_CMD_BATCH                           = 0x49, //!< execute a list of commands: (descriptor, length, data) each
+    USB_CMD_STREAM_CREDIT                   = 0x4A, //!< grant frame credits to streams: bitmask, count (uint16, 0xFFFF = unlimited)
+    USB_CMD_SET_BAUDRATE                    = 0x4B, //!< switch host link rate (uint32), pending a probe at the new rate
+    USB_CMD_BAUDRATE_PROBE                  = 0x4C, //!< confirm the new host link rate: payload is echoed back
+    USB_CMD_DUMP_MEM                        = 0x4D, //!< stream target memory: address (uint32), length (uint32, up to CONFIG_DUMP_MEM_MAX_LEN)
+    USB_CMD_WRITE_MEM_BULK                  = 0x4E, //!< write and verify target memory: address (uint32), length (uint16), first bytes
+    USB_CMD_GET_MEM_CACHE_STATS             = 0x4F, //!< get counters of the target memory read cache
+    USB_CMD_SNAPSHOT_REGION                 = 0x50, //!< set a region to capture in debug mode: index, address (uint32), length (uint16)
+    USB_CMD_CRC_MEM                         = 0x51, //!< CRC of blocks of target memory: address, length, block length (uint32 each)
+    USB_CMD_READ_MEM_GATHER                 = 0x52, //!< read a list of ranges of target memory: address (uint32), length (uint8) each
+    USB_CMD_SET_CONTEXT_WINDOW              = 0x53, //!< set memory to send with the interrupt context: address (uint32), length (uint8)
+    USB_CMD_SET_TARGET_BAUDRATE             = 0x54, //!< switch target link rate (uint32) for the rest of the debug mode session
+    USB_CMD_WRITE_MEM_BULK_DATA             = 0x55, //!< more bytes for USB_CMD_WRITE_MEM_BULK: offset (uint16), bytes
 } usb_cmd_t;
 
 /**
@@ -96,9 +159,27 @@ typedef enum {
     USB_RSP_STDIO                           = 0x12, //!< printf data from target
     USB_RSP_WATCHPOINT                      = 0x13, //!< watchpoint event info
     USB_RSP_PARAM                           = 0x14, //!< configurable parameter value
-    USB_RSP_ENERGY_PROFILE                  = 0x15, //!< collected energy profile
+    USB_RSP_ENERGY_PROFILE                  = 0x15, //!< periodic payload record: seq, vcap min/max/avg, watchpoint hits (uint16 each), app output length, app output
+    USB_RSP_HOST_LINK_STATS                 = 0x16, //!< rx msgs, crc errors, framing errors, resyncs, rx overruns (uint16 each)
+    USB_RSP_BATCH                           = 0x17, //!< count of commands executed from a batch and their return codes
+    USB_RSP_BAUDRATE_PROBE                  = 0x18, //!< echo of the payload of a baudrate probe
+    USB_RSP_MEMORY_DUMP                     = 0x19, //!< part of a memory dump: address (uint32), bytes (a return code follows the last)
+    USB_RSP_MEM_CACHE_STATS                 = 0x1A, //!< hits, misses (uint16 each)
+    USB_RSP_SNAPSHOT                        = 0x1B, //!< changed blocks of a region: index, first block, bitmap (uint32), blocks (a return code follows the last)
+    USB_RSP_MEMORY_CRC                      = 0x1C, //!< CRCs of blocks: address (uint32), CRC (uint16) per block (a return code follows the last)
+    USB_RSP_WISP_MEMORY_GATHER              = 0x1D, //!< bytes of a list of ranges of target memory, in list order
+    USB_RSP_INTERRUPT_CONTEXT_EXT           = 0x1E, //!< follows INTERRUPTED: type, id, saved and restored vcap (uint16), pc, window address (uint32), window bytes
+    USB_RSP_STDIO_RECORDS                   = 0x1F, //!< printf data from target: bytes dropped (uint16), then timestamp (uint32), length, bytes per record
 } usb_rsp_t;
 
+/**
+ * @brief Options for the host link, negotiated per session
+ */
+typedef enum {
+    HOST_LINK_FRAMED                        = 0x01, //!< COBS-delimited messages with CRC-16
+    HOST_LINK_EXT_LEN                       = 0x02, //!< extended header with 16-bit length
+} host_link_flag_t;
+
 
 /**
  * @brief Return codes for return code message
@@ -110,6 +191,8 @@ typedef enum {
     RETURN_CODE_COMM_ERROR                  = 3,
     RETURN_CODE_UNSUPPORTED                 = 4,
     RETURN_CODE_BUSY                        = 5,
+    RETURN_CODE_VERIFY_FAILED               = 6, //!< memory read back does not match what was written
+    RETURN_CODE_NONE                        = 0xFF, //!< command in a batch did not send a return code
 } return_code_t;
 
 /** @} End UART_PROTOCOL */
@@ -119,11 +202,16 @@ typedef enum {
     PARAM_TARGET_BOOT_VOLTAGE_DL            = 1, //!< regulated voltage threshold for determinining target is on
     PARAM_TARGET_BOOT_LATENCY_KCYCLES       = 2, //!< time for target to start listening for EDB signals after voltage reaches on threshold
     PARAM_NUM_WATCHPOINT_EVENTS_BUFFERED    = 3, //!< number of watchpoint events to buffer before sending to host
+    PARAM_NUM_ADC_BUFFERS                   = 4, //!< number of buffers in the voltage sample ring (applied on stream start)
+    PARAM_NUM_ADC_SAMPLES_BUFFERED          = 5, //!< number of samples per voltage stream frame (applied on stream start)
 } param_t;
 
 /* @brief Max supported value of PARAM_NUM_WATCHPOINT_EVENTS_BUFFERED */
 #define MAX_WATCHPOINT_EVENTS_BUFFERED 16
 
+/* @brief Max supported value of PARAM_NUM_ADC_SAMPLES_BUFFERED (num events field is one byte) */
+#define MAX_ADC_SAMPLES_BUFFERED 255
+
 /**
  * @brief Specifies the type of breakpoint among ones supported
  *
@@ -256,9 +344,25 @@ typedef enum {
 #define RF_EVENT_TYPE_ERROR             0x0E00
 /* @} End RF_EVENT_TYPE */
 
+/**
+ * @brief Stream data message header: streams bitmask, sample count (ADC
+ *        streams, padding otherwise), the number of items dropped (uint16)
+ *        right before the first item in this message, and the gap: the
+ *        timestamps (uint32) of the first and last dropped item
+ * @details Items are dropped when the producer has no free buffer: either
+ *          the host link is too slow, or the host ran out of credits
+ *          granted with USB_CMD_STREAM_CREDIT. The stream keeps running.
+ *          The gap timestamps are zero when the dropped count is zero.
+ */
 #define STREAM_DATA_STREAMS_BITMASK_LEN     1
 #define STREAM_DATA_PADDING_LEN             1
-#define STREAM_DATA_MSG_HEADER_LEN  (STREAM_DATA_STREAMS_BITMASK_LEN + STREAM_DATA_PADDING_LEN)
+#define STREAM_DATA_DROPPED_LEN             2
+#define STREAM_DATA_GAP_LEN                 8
+#define STREAM_DATA_MSG_HEADER_LEN  (STREAM_DATA_STREAMS_BITMASK_LEN + STREAM_DATA_PADDING_LEN + \
+                                     STREAM_DATA_DROPPED_LEN + STREAM_DATA_GAP_LEN)
+
+#define STREAM_DATA_DROPPED_OFFSET  (STREAM_DATA_STREAMS_BITMASK_LEN + STREAM_DATA_PADDING_LEN)
+#define STREAM_DATA_GAP_OFFSET      (STREAM_DATA_DROPPED_OFFSET + STREAM_DATA_DROPPED_LEN)
 
 // The header must be aligned because we need pointers *within* the buffer to payload field
 #if STREAM_DATA_MSG_HEADER_LEN & 0x1 == 0x1
@@ -5,17 +5,34 @@
 
 #include "host_comm.h"
 #include "interrupt.h"
+#include "uart.h"
 
 #define HOST_MSG_BUF_SIZE       64 // buffer for UART messages (to host) for main loop
+#define HOST_MSG_BUF_COUNT       4 // messages that can be queued for TX at once
+
+// max commands in a batch: each takes at least a descriptor and a length byte
+#define HOST_BATCH_MAX_CMDS     ((UART_HOST_RX_MSG_MAX_LEN - UART_MSG_HEADER_SIZE) / 2)
+
+#if 1 + HOST_BATCH_MAX_CMDS > HOST_MSG_BUF_SIZE
+#error Batch reply does not fit in a host message buffer: HOST_BATCH_MAX_CMDS
+#endif
 
 // TODO: prefix names with host_comm
 
 void send_voltage(uint16_t voltage);
 void send_return_code(unsigned code);
 void send_interrupt_context(interrupt_context_t *int_context);
+void send_interrupt_context_ext(interrupt_context_t *int_context, uint32_t pc,
+                                uint32_t window_address, uint8_t *window, unsigned window_len);
 void send_param(param_t param);
 void send_echo(uint8_t value);
 void forward_msg_to_host(unsigned descriptor, uint8_t *buf, unsigned len);
+void send_host_link_stats();
+void send_mem_cache_stats();
+
+void begin_batch();
+void begin_batch_cmd();
+void end_batch();
 
 #endif
 
@@ -186,6 +186,12 @@
 #define UART_TARGET                             1
 
 #define DMA_HOST_UART_TX                        0 //!< DMA channel for UART TX to host
+#define DMA_HOST_UART_RX                        1 //!< DMA channel for UART RX from host
+#ifdef CONFIG_ADC_DMA
+#define DMA_ADC                                 2 //!< DMA channel for ADC results (target TX falls back to ISR)
+#else // !CONFIG_ADC_DMA
+#define DMA_TARGET_UART_TX                      2 //!< DMA channel for UART TX to target
+#endif // !CONFIG_ADC_DMA
 
 #if BOARD_EDB_1_1
 
@@ -214,6 +220,11 @@
 #define TIMER_SCHED_IDX                         1
 #define TIMER_SCHED_CCR                         1 //!< timer capture-compare register index
 
+// !< timeout of requests to target: a compare on the free-running systick timer
+#define TIMER_XACT_TYPE                         A
+#define TIMER_XACT_IDX                          2
+#define TIMER_XACT_CCR                          0 //!< timer capture-compare register index
+
 #define TMRMOD_ADC_TRIGGER                      B //!< timer module for ADC trigger in stream mode
 #define TMRIDX_ADC_TRIGGER                      0 //!< timer index for ADC trigger in stream mode
 #define TMRCC_ADC_TRIGGER                       0 //!< timer capture-compare register index
@@ -325,6 +336,11 @@
 #define TIMER_SCHED_IDX                         1
 #define TIMER_SCHED_CCR                         0 //!< timer capture-compare register index
 
+// !< timeout of requests to target: a compare on the free-running systick timer
+#define TIMER_XACT_TYPE                         A
+#define TIMER_XACT_IDX                          2
+#define TIMER_XACT_CCR                          0 //!< timer capture-compare register index
+
 /** @} End PORTS */
 
 // TODO: define only numbers here and use a macro that takes a number (for consistency)
@@ -357,5 +373,39 @@
 #error Invalid DMA channel index: DMA_HOST_UART_TX
 #endif
 
+#if DMA_HOST_UART_RX == 0
+#define DMA_HOST_UART_RX_CTL 0
+#elif DMA_HOST_UART_RX == 1
+#define DMA_HOST_UART_RX_CTL 0
+#elif DMA_HOST_UART_RX == 2
+#define DMA_HOST_UART_RX_CTL 1
+#else
+#error Invalid DMA channel index: DMA_HOST_UART_RX
+#endif
+
+#ifdef DMA_TARGET_UART_TX
+#if DMA_TARGET_UART_TX == 0
+#define DMA_TARGET_UART_TX_CTL 0
+#elif DMA_TARGET_UART_TX == 1
+#define DMA_TARGET_UART_TX_CTL 0
+#elif DMA_TARGET_UART_TX == 2
+#define DMA_TARGET_UART_TX_CTL 1
+#else
+#error Invalid DMA channel index: DMA_TARGET_UART_TX
+#endif
+#endif // DMA_TARGET_UART_TX
+
+#ifdef DMA_ADC
+#if DMA_ADC == 0
+#define DMA_ADC_CTL 0
+#elif DMA_ADC == 1
+#define DMA_ADC_CTL 0
+#elif DMA_ADC == 2
+#define DMA_ADC_CTL 1
+#else
+#error Invalid DMA channel index: DMA_ADC
+#endif
+#endif // DMA_ADC
+
 
 #endif // PIN_ASSIGN_H
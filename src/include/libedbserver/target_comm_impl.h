@@ -16,5 +16,6 @@ void target_comm_send_write_mem(uint32_t address, uint8_t *value, unsigned len);
 void target_comm_send_exit_debug_mode();
 void target_comm_send_echo(uint8_t value);
 void target_comm_send_get_app_output();
+void target_comm_send_set_baudrate(uint32_t baudrate);
 
 #endif // TARGET_COMM_IMPL_H
@@ -10,281 +10,98 @@
 
 // UART baudrate specification:
 //
+// The divisor N = CLOCK / BAUD is rounded to the resolution of the
+// modulation stage, 1/8 (BRS) without oversampling, 1/16 (BRF) with UCOS16:
+//
 // Not UCOS16:
 //
-// N = SMCLK / BAUD
-// BR0 = LSB(floor(N))
-// BR1 = MSB(floor(N))
-// BRS = (floor(N) - N) * 8
+// D = round(N * 8)
+// BR0 = LSB(D / 8)
+// BR1 = MSB(D / 8)
+// BRS = D % 8
 //
 // UCOS16:
 //
-// N = SMCLK / BAUD
-// BR0 = LSB(floor(N/16))
-// BR1 = MSB(floor(N/16))
-// BRF = (floor(N/16) - N/16) * 16
+// D = round(N)
+// BR0 = LSB(D / 16)
+// BR1 = MSB(D / 16)
+// BRF = D % 16
 // UCOS16 = 1
+//
+// The error of the resulting average bit rate must not exceed
+// CONFIG_UART_MAX_BAUD_ERROR_PPM. The modulation pattern adds at most one
+// clock cycle of jitter per bit on top of that.
 
-#if CONFIG_UART_CLOCK_FREQ == 24576000
-
-#if CONFIG_USB_UART_BAUDRATE == 1000000
-
-#ifdef CONFIG_USB_UART_UCOS16
-
-// N/16 = 24.576
-#define CONFIG_USB_UART_BAUDRATE_BR0 0x01
-#define CONFIG_USB_UART_BAUDRATE_BR1 0x00
-#define CONFIG_USB_UART_BAUDRATE_BRF 9
-#define CONFIG_USB_UART_BAUDRATE_UCOS16 1
-
-#endif // CONFIG_USB_UART_UCOS16
-
-#elif CONFIG_USB_UART_BAUDRATE == 921600
-
-#ifdef CONFIG_USB_UART_UCOS16
-// N/16 = 1.66666...
-#define CONFIG_USB_UART_BAUDRATE_BR0 0x01
-#define CONFIG_USB_UART_BAUDRATE_BR1 0x00
-#define CONFIG_USB_UART_BAUDRATE_BRF 10
-#define CONFIG_USB_UART_BAUDRATE_UCOS16 1
-#endif // CONFIG_USB_UART_UCOS16
-
-#elif CONFIG_USB_UART_BAUDRATE == 576000
-
-#ifdef CONFIG_USB_UART_UCOS16
-// N/16 = 2.66666...
-#define CONFIG_USB_UART_BAUDRATE_BR0 0x02
-#define CONFIG_USB_UART_BAUDRATE_BR1 0x00
-#define CONFIG_USB_UART_BAUDRATE_BRF 10
-#define CONFIG_USB_UART_BAUDRATE_UCOS16 1
-#endif // CONFIG_USB_UART_UCOS16
-
-#elif CONFIG_USB_UART_BAUDRATE == 500000
-
-#ifdef CONFIG_USB_UART_UCOS16
-// N/16 = 3.072
-#define CONFIG_USB_UART_BAUDRATE_BR0 0x03
-#define CONFIG_USB_UART_BAUDRATE_BR1 0x00
-#define CONFIG_USB_UART_BAUDRATE_BRF 1
-#define CONFIG_USB_UART_BAUDRATE_UCOS16 1
-#endif // CONFIG_USB_UART_UCOS16
-
-#elif CONFIG_USB_UART_BAUDRATE == 115200
-
-#ifdef CONFIG_USB_UART_UCOS16
-// N/16 = 13.3333...
-#define CONFIG_USB_UART_BAUDRATE_BR0 0x0d
-#define CONFIG_USB_UART_BAUDRATE_BR1 0x00
-#define CONFIG_USB_UART_BAUDRATE_BRF 5
-#define CONFIG_USB_UART_BAUDRATE_UCOS16 1
-#endif // CONFIG_USB_UART_UCOS16
-
-#elif CONFIG_USB_UART_BAUDRATE == 38400
-// N = 640
-#define CONFIG_USB_UART_BAUDRATE_BR0 0x80
-#define CONFIG_USB_UART_BAUDRATE_BR1 0x02
-#define CONFIG_USB_UART_BAUDRATE_BRS 0
-
-#endif // CONFIG_USB_UART_BAUDRATE
-
-#if CONFIG_TARGET_UART_BAUDRATE == 9600
-// N = 2560
-#define CONFIG_TARGET_UART_BAUDRATE_BR0 0x00
-#define CONFIG_TARGET_UART_BAUDRATE_BR1 0x0a
-#define CONFIG_TARGET_UART_BAUDRATE_BRS 0
-
-#endif // CONFIG_TARGET_UART_BAUDRATE
-
-#elif CONFIG_UART_CLOCK_FREQ == 21921792
-
-#if CONFIG_USB_UART_BAUDRATE == 921600
-// N = 23.786666...
-#define CONFIG_USB_UART_BAUDRATE_BR0 23
-#define CONFIG_USB_UART_BAUDRATE_BR1 0
-#define CONFIG_USB_UART_BAUDRATE_BRS 6
-
-#elif CONFIG_USB_UART_BAUDRATE == 171264
-
-// N = 128
-#define CONFIG_USB_UART_BAUDRATE_BR0 128
-#define CONFIG_USB_UART_BAUDRATE_BR1 0
-#define CONFIG_USB_UART_BAUDRATE_BRS 0
-
-#elif CONFIG_USB_UART_BAUDRATE == 115200
-
-// N = 190.293333...
-#define CONFIG_USB_UART_BAUDRATE_BR0 0xBE
-#define CONFIG_USB_UART_BAUDRATE_BR1 0
-#define CONFIG_USB_UART_BAUDRATE_BRS 2
-
-#endif // CONFIG_USB_UART_BAUDRATE
-
-#if CONFIG_TARGET_UART_BAUDRATE == 9600
-// N = 2283.52
-#define CONFIG_TARGET_UART_BAUDRATE_BR0 0xEB
-#define CONFIG_TARGET_UART_BAUDRATE_BR1 0x08
-#define CONFIG_TARGET_UART_BAUDRATE_BRS 4
-
-#endif // CONFIG_TARGET_UART_BAUDRATE
-
-#elif CONFIG_UART_CLOCK_FREQ == 12500000
-
-#if CONFIG_USB_UART_BAUDRATE == 2000000
-#define CONFIG_USB_UART_BAUDRATE_BR0 6
-#define CONFIG_USB_UART_BAUDRATE_BR1 0
-#define CONFIG_USB_UART_BAUDRATE_BRS 2
-
-#elif CONFIG_USB_UART_BAUDRATE == 1000000
-#define CONFIG_USB_UART_BAUDRATE_BR0 12
-#define CONFIG_USB_UART_BAUDRATE_BR1 0
-#define CONFIG_USB_UART_BAUDRATE_BRS 4
-
-#elif CONFIG_USB_UART_BAUDRATE == 115200
-#define CONFIG_USB_UART_BAUDRATE_BR0 108
-#define CONFIG_USB_UART_BAUDRATE_BR1 0
-#define CONFIG_USB_UART_BAUDRATE_BRS 4
-
-#endif // CONFIG_USB_UART_BAUDRATE
-
-#if CONFIG_TARGET_UART_BAUDRATE == 9600
-#define CONFIG_TARGET_UART_BAUDRATE_BR0 0x16
-#define CONFIG_TARGET_UART_BAUDRATE_BR1 0x05
-#define CONFIG_TARGET_UART_BAUDRATE_BRS 1
-
-#endif // CONFIG_TARGET_UART_BAUDRATE
-
-#elif CONFIG_UART_CLOCK_FREQ == 6250000
-
-#if CONFIG_USB_UART_BAUDRATE == 115200
-#define CONFIG_USB_UART_BAUDRATE_BR0 54
-#define CONFIG_USB_UART_BAUDRATE_BR1 0
-#define CONFIG_USB_UART_BAUDRATE_BRS 2
-
-#endif
-
-#elif CONFIG_UART_CLOCK_FREQ == 24000000
+#define UART_ABS_DIFF(a, b) ((a) > (b) ? (a) - (b) : (b) - (a))
 
-#if CONFIG_USB_UART_BAUDRATE == 2000000
-// N = 12
-#define CONFIG_USB_UART_BAUDRATE_BR0 12
-#define CONFIG_USB_UART_BAUDRATE_BR1 0
-#define CONFIG_USB_UART_BAUDRATE_BRS 0
+#define UART_DIVISOR(clk, baud, scale) \
+    (((clk) * (scale) + (baud) / 2) / (baud))
+#define UART_BAUD_ERROR_PPM(clk, baud, scale) \
+    (UART_ABS_DIFF(UART_DIVISOR(clk, baud, scale) * (baud), (clk) * (scale)) * \
+     1000000 / ((clk) * (scale)))
 
-#elif CONFIG_USB_UART_BAUDRATE == 1000000
+#ifdef CONFIG_USB_UART_BAUDRATE
 
 #ifdef CONFIG_USB_UART_UCOS16
-#define CONFIG_USB_UART_BAUDRATE_BR0 1
-#define CONFIG_USB_UART_BAUDRATE_BR1 0
-#define CONFIG_USB_UART_BAUDRATE_BRF 8
+#define CONFIG_USB_UART_BAUDRATE_DIV \
+    UART_DIVISOR(CONFIG_UART_CLOCK_FREQ, CONFIG_USB_UART_BAUDRATE, 1)
+#define CONFIG_USB_UART_BAUDRATE_ERROR_PPM \
+    UART_BAUD_ERROR_PPM(CONFIG_UART_CLOCK_FREQ, CONFIG_USB_UART_BAUDRATE, 1)
+#define CONFIG_USB_UART_BAUDRATE_BR (CONFIG_USB_UART_BAUDRATE_DIV / 16)
+#define CONFIG_USB_UART_BAUDRATE_BRF (CONFIG_USB_UART_BAUDRATE_DIV % 16)
 #define CONFIG_USB_UART_BAUDRATE_UCOS16 1
 #else // !CONFIG_USB_UART_UCOS16
-// N = 24
-#define CONFIG_USB_UART_BAUDRATE_BR0 24
-#define CONFIG_USB_UART_BAUDRATE_BR1 0
-#define CONFIG_USB_UART_BAUDRATE_BRS 0
+#define CONFIG_USB_UART_BAUDRATE_DIV \
+    UART_DIVISOR(CONFIG_UART_CLOCK_FREQ, CONFIG_USB_UART_BAUDRATE, 8)
+#define CONFIG_USB_UART_BAUDRATE_ERROR_PPM \
+    UART_BAUD_ERROR_PPM(CONFIG_UART_CLOCK_FREQ, CONFIG_USB_UART_BAUDRATE, 8)
+#define CONFIG_USB_UART_BAUDRATE_BR (CONFIG_USB_UART_BAUDRATE_DIV / 8)
+#define CONFIG_USB_UART_BAUDRATE_BRS (CONFIG_USB_UART_BAUDRATE_DIV % 8)
 #endif // !CONFIG_USB_UART_UCOS16
 
-#elif CONFIG_USB_UART_BAUDRATE == 1500000
+#define CONFIG_USB_UART_BAUDRATE_BR0 (CONFIG_USB_UART_BAUDRATE_BR & 0xff)
+#define CONFIG_USB_UART_BAUDRATE_BR1 (CONFIG_USB_UART_BAUDRATE_BR >> 8)
 
-#ifdef CONFIG_USB_UART_UCOS16
-// N = 1
-#define CONFIG_USB_UART_BAUDRATE_BR0 1
-#define CONFIG_USB_UART_BAUDRATE_BR1 0
-#define CONFIG_USB_UART_BAUDRATE_BRF 0
-#define CONFIG_USB_UART_BAUDRATE_UCOS16 1
-#endif // CONFIG_USB_UART_UCOS16
-
-#elif CONFIG_USB_UART_BAUDRATE == 500000
-// N = 48
-#define CONFIG_USB_UART_BAUDRATE_BR0 48
-#define CONFIG_USB_UART_BAUDRATE_BR1 0
-#define CONFIG_USB_UART_BAUDRATE_BRS 0
-
-#elif CONFIG_USB_UART_BAUDRATE == 115200
-
-#ifdef CONFIG_USB_UART_UCOS16
-// N = 13.0208333...
-#define CONFIG_USB_UART_BAUDRATE_BR0 13
-#define CONFIG_USB_UART_BAUDRATE_BR1 0
-#define CONFIG_USB_UART_BAUDRATE_BRF 1
-#define CONFIG_USB_UART_BAUDRATE_UCOS16 1
-
-#else // !CONFIG_USB_UART_UCOS16
-// N = 208.33333..
-#define CONFIG_USB_UART_BAUDRATE_BR0 0xD0
-#define CONFIG_USB_UART_BAUDRATE_BR1 0
-#define CONFIG_USB_UART_BAUDRATE_BRS 3
-#endif // !CONFIG_USB_UART_UCOS16
+#if CONFIG_USB_UART_BAUDRATE_BR == 0 || CONFIG_USB_UART_BAUDRATE_BR > 0xffff
+#error Host UART configuration error: baudrate out of range for CONFIG_UART_CLOCK_FREQ
+#endif
+#if CONFIG_USB_UART_BAUDRATE_ERROR_PPM > CONFIG_UART_MAX_BAUD_ERROR_PPM
+#error Host UART configuration error: baudrate error exceeds CONFIG_UART_MAX_BAUD_ERROR_PPM
+#endif
 
 #endif // CONFIG_USB_UART_BAUDRATE
 
-#if CONFIG_TARGET_UART_BAUDRATE == 9600
-// N = 2500
-#define CONFIG_TARGET_UART_BAUDRATE_BR0 0xC4
-#define CONFIG_TARGET_UART_BAUDRATE_BR1 0x09
-#define CONFIG_TARGET_UART_BAUDRATE_BRS 0
-
-#elif CONFIG_TARGET_UART_BAUDRATE == 115200
+#ifdef CONFIG_TARGET_UART_BAUDRATE
 
-// N = 13.0208333...
-#define CONFIG_TARGET_UART_BAUDRATE_BR0 13
-#define CONFIG_TARGET_UART_BAUDRATE_BR1 0
-#define CONFIG_TARGET_UART_BAUDRATE_BRF 0
+#ifdef CONFIG_TARGET_UART_UCOS16
+#define CONFIG_TARGET_UART_BAUDRATE_DIV \
+    UART_DIVISOR(CONFIG_UART_CLOCK_FREQ, CONFIG_TARGET_UART_BAUDRATE, 1)
+#define CONFIG_TARGET_UART_BAUDRATE_ERROR_PPM \
+    UART_BAUD_ERROR_PPM(CONFIG_UART_CLOCK_FREQ, CONFIG_TARGET_UART_BAUDRATE, 1)
+#define CONFIG_TARGET_UART_BAUDRATE_BR (CONFIG_TARGET_UART_BAUDRATE_DIV / 16)
+#define CONFIG_TARGET_UART_BAUDRATE_BRF (CONFIG_TARGET_UART_BAUDRATE_DIV % 16)
 #define CONFIG_TARGET_UART_BAUDRATE_UCOS16 1
-
-#endif // CONFIG_TARGET_UART_BAUDRATE
-
-#elif CONFIG_UART_CLOCK_FREQ == 12000000
-
-#if CONFIG_USB_UART_BAUDRATE == 2000000
-// N = 6
-#define CONFIG_USB_UART_BAUDRATE_BR0 6
-#define CONFIG_USB_UART_BAUDRATE_BR1 0
-#define CONFIG_USB_UART_BAUDRATE_BRS 0
-
-#elif CONFIG_USB_UART_BAUDRATE == 460800
-// N = 26.041666... 
-#define CONFIG_USB_UART_BAUDRATE_BR0 26
-#define CONFIG_USB_UART_BAUDRATE_BR1 0
-#define CONFIG_USB_UART_BAUDRATE_BRS 0
-
-#elif CONFIG_USB_UART_BAUDRATE == 115200
-
-// N = 104.16666...
-#define CONFIG_USB_UART_BAUDRATE_BR0 104
-#define CONFIG_USB_UART_BAUDRATE_BR1 0
-#define CONFIG_USB_UART_BAUDRATE_BRS 1
-
-#endif // CONFIG_USB_UART_BAUDRATE
-
-#if CONFIG_TARGET_UART_BAUDRATE == 9600
-// N = 1250
-#define CONFIG_TARGET_UART_BAUDRATE_BR0 0xE2
-#define CONFIG_TARGET_UART_BAUDRATE_BR1 0x04
-#define CONFIG_TARGET_UART_BAUDRATE_BRS 0
-
-#endif // CONFIG_TARGET_UART_BAUDRATE
-
-#elif CONFIG_UART_CLOCK_FREQ == 8192000
-
-#if CONFIG_TARGET_UART_BAUDRATE == 115200
-// N = 71.1111...
-#define CONFIG_TARGET_UART_BAUDRATE_BR0 0x47
-#define CONFIG_TARGET_UART_BAUDRATE_BR1 0x00
-#define CONFIG_TARGET_UART_BAUDRATE_BRS 1
-
-#endif // CONFIG_TARGET_UART_BAUDRATE
-
-#endif // CONFIG_UART_CLOCK_FREQ_*
-
-#if defined(CONFIG_USB_UART_BAUDRATE) && !defined(CONFIG_USB_UART_BAUDRATE_BR0)
-#error Host UART configuration error: no config for selected CONFIG_UART_CLOCK_FREQ
+#else // !CONFIG_TARGET_UART_UCOS16
+#define CONFIG_TARGET_UART_BAUDRATE_DIV \
+    UART_DIVISOR(CONFIG_UART_CLOCK_FREQ, CONFIG_TARGET_UART_BAUDRATE, 8)
+#define CONFIG_TARGET_UART_BAUDRATE_ERROR_PPM \
+    UART_BAUD_ERROR_PPM(CONFIG_UART_CLOCK_FREQ, CONFIG_TARGET_UART_BAUDRATE, 8)
+#define CONFIG_TARGET_UART_BAUDRATE_BR (CONFIG_TARGET_UART_BAUDRATE_DIV / 8)
+#define CONFIG_TARGET_UART_BAUDRATE_BRS (CONFIG_TARGET_UART_BAUDRATE_DIV % 8)
+#endif // !CONFIG_TARGET_UART_UCOS16
+
+#define CONFIG_TARGET_UART_BAUDRATE_BR0 (CONFIG_TARGET_UART_BAUDRATE_BR & 0xff)
+#define CONFIG_TARGET_UART_BAUDRATE_BR1 (CONFIG_TARGET_UART_BAUDRATE_BR >> 8)
+
+#if CONFIG_TARGET_UART_BAUDRATE_BR == 0 || CONFIG_TARGET_UART_BAUDRATE_BR > 0xffff
+#error Target UART configuration error: baudrate out of range for CONFIG_UART_CLOCK_FREQ
 #endif
-
-#if defined(CONFIG_TARGET_UART_BAUDRATE) && !defined(CONFIG_TARGET_UART_BAUDRATE_BR0)
-#error Target UART configuration error: no config for selected CONFIG_UART_CLOCK_FREQ
+#if CONFIG_TARGET_UART_BAUDRATE_ERROR_PPM > CONFIG_UART_MAX_BAUD_ERROR_PPM
+#error Target UART configuration error: baudrate error exceeds CONFIG_UART_MAX_BAUD_ERROR_PPM
 #endif
 
+#endif // CONFIG_TARGET_UART_BAUDRATE
+
 
 /**
  * @defgroup    UART_INTERFACES UART interfaces
@@ -300,17 +117,47 @@
  * @brief       Macros for use with UART
  * @{
  */
-#define UART_DISABLE_USB_RX                     UCA0IE &= ~UCRXIE	//!< Disable RX interrupt for USB
-#define UART_ENABLE_USB_RX                      UCA0IE |= UCRXIE	//!< Enable RX interrupt for USB
 #define UART_DISABLE_WISP_RX                    UCA1IE &= ~UCRXIE	//!< Disable RX interrupt for WISP UART
 #define UART_ENABLE_WISP_RX                     UCA1IE |= UCRXIE	//!< Enable RX interrupt for WISP UART
 /** @} End UART_MACROS */
 
-#define UART_MSG_HEADER_SIZE                    4 // marker, msg id, size, padding (must be aligned to 2)
+#define UART_MSG_HEADER_SIZE                    4 // marker, msg id, size, seq/tag (must be aligned to 2)
+#define UART_MSG_EXT_HEADER_SIZE                6 // marker, msg id, size LSB, seq, size MSB, padding
 
-#define UART_BUF_MAX_LEN                        64
-#define UART_BUF_MAX_LEN_WITH_TAIL				(UART_BUF_MAX_LEN + 1) //!< Add a byte because the tail should never point to a full byte
+#define UART_BUF_MAX_LEN                        64 //!< Max length of a UART message (incl. header)
 #define UART_PKT_MAX_DATA_LEN                   (UART_BUF_MAX_LEN - UART_MSG_HEADER_SIZE)
+#define UART_HOST_RX_MSG_MAX_LEN                128 //!< Max length of a message from host (incl. header)
+
+#define UART_HOST_RX_RING_SIZE                  256 //!< Host RX ring (filled by DMA), power of 2
+#define UART_TARGET_RX_RING_SIZE                128 //!< Target RX ring (filled by ISR), power of 2
+#define UART_HOST_TX_QUEUE_LEN                  8   //!< Host TX DMA descriptors (one is kept free), power of 2
+#define UART_HOST_CMD_QUEUE_LEN                 4   //!< Host commands parsed ahead of execution, power of 2
+
+#define UART_FRAME_CRC_SIZE                     2 //!< CRC-16 trailer of a framed message
+
+/**
+ * @brief Max length on the wire of a framed message of the given length
+ * @details COBS adds an overhead byte per 254 bytes (at least one), then
+ *          there is the delimiter.
+ */
+#define UART_FRAME_ENCODED_LEN(len) \
+    ((len) + UART_FRAME_CRC_SIZE + ((len) + UART_FRAME_CRC_SIZE) / 254 + 2)
+
+#define UART_HOST_RX_FRAME_MAX_LEN              UART_FRAME_ENCODED_LEN(UART_HOST_RX_MSG_MAX_LEN)
+#define UART_HOST_TX_FRAME_BUF_SIZE             1024 //!< Encoded frames waiting for TX
+
+// Max payload of a message whose encoded frame fits in the frame buffer
+#define UART_HOST_TX_FRAME_MAX_PAYLOAD_LEN \
+    (UART_HOST_TX_FRAME_BUF_SIZE - UART_HOST_TX_FRAME_BUF_SIZE / 254 - \
+     UART_FRAME_CRC_SIZE - 2 - UART_MSG_EXT_HEADER_SIZE)
+
+// RX rings are followed by this many bytes for making wrapped messages contiguous
+#ifdef CONFIG_HOST_UART_FRAMING
+#define UART_HOST_RX_SPILL_LEN                  UART_HOST_RX_FRAME_MAX_LEN
+#else
+#define UART_HOST_RX_SPILL_LEN                  UART_HOST_RX_MSG_MAX_LEN
+#endif
+#define UART_TARGET_RX_SPILL_LEN                UART_BUF_MAX_LEN
 
 // TODO: factor out a uart protocol header (even a whole library)
 #if UART_PKT_MAX_DATA_LEN < STDIO_PAYLOAD_SIZE
@@ -322,44 +169,127 @@
 #error UART message header size must be aligned to 2
 #endif
 
-/**
- * @brief       Enumeration used to place a UART message into a variable of type uartPkt_t.
- */
-typedef enum {
-    CONSTRUCT_STATE_IDENTIFIER,     //!< Currently parsing the UART identifier from the software buffer
-    CONSTRUCT_STATE_DESCRIPTOR,     //!< Currently parsing the message descriptor from the software buffer
-    CONSTRUCT_STATE_DATA_LEN,       //!< Currently parsing length of the data from the software buffer
-    CONSTRUCT_STATE_PADDING,        //!< Padding in msg header for alignment
-    CONSTRUCT_STATE_DATA            //!< Currently parsing the message data from the software buffer
-} pktConstructState_t;
+#if (UART_HOST_RX_RING_SIZE & (UART_HOST_RX_RING_SIZE - 1)) || \
+    (UART_TARGET_RX_RING_SIZE & (UART_TARGET_RX_RING_SIZE - 1)) || \
+    (UART_HOST_TX_QUEUE_LEN & (UART_HOST_TX_QUEUE_LEN - 1)) || \
+    (UART_HOST_CMD_QUEUE_LEN & (UART_HOST_CMD_QUEUE_LEN - 1))
+#error UART ring sizes must be powers of 2
+#endif
+
+// A ring holds one byte less than its size (the tail never points to a full byte)
+#if UART_TARGET_RX_RING_SIZE <= UART_BUF_MAX_LEN || \
+    UART_HOST_RX_RING_SIZE <= UART_HOST_RX_MSG_MAX_LEN
+#error UART RX ring too small for a max-length message
+#endif
+
+#if UART_HOST_RX_MSG_MAX_LEN < UART_BUF_MAX_LEN
+#error Host RX message limit is below the UART message length
+#endif
 
 /**
  * @brief       UART message packet structure
+ * @details     The packet does not own a copy of the payload: the data field
+ *              points at the payload inside the RX ring, which stays reserved
+ *              until the packet is marked as processed. A payload that wraps
+ *              around the end of the ring is made contiguous by copying the
+ *              wrapped part into the spill area that follows the ring storage.
+ *
+ *              The payload is not necessarily aligned, so multi-byte fields
+ *              must be read with uartPkt_u16/uartPkt_u32.
  */
 typedef struct {
-    uint8_t data[UART_PKT_MAX_DATA_LEN];    //!< Data field of the UART message
+    uint8_t *data;                           //!< Data field of the UART message (in the RX ring)
     unsigned identifier;                     //!< UART message identifier
     unsigned descriptor;                     //!< Message descriptor
     unsigned length;                         //!< Message data length
+    unsigned seq;                            //!< Sequence ID (from host), or request tag (from target)
+    unsigned end;                            //!< Ring index past the message
     unsigned processed;                      //!< Indicates whether the packet structure is free to be overwritten
 } uartPkt_t;
 
 /**
  * @brief       Circular buffer type for UART communication
+ * @details     The size of the storage must be a power of two, so that
+ *              indexes wrap with a mask. RX rings have UART_*_RX_SPILL_LEN
+ *              extra bytes of storage past the end (the spill area).
  */
 typedef struct {
-    uint8_t buf[UART_BUF_MAX_LEN_WITH_TAIL];  //!< Circular buffer to be used for UART interfaces
-    unsigned head;                   //!< Relative buffer head
-    unsigned tail;                   //!< Relative buffer tail
+    uint8_t *buf;                    //!< Storage of the circular buffer
+    unsigned mask;                   //!< Size of the storage minus one
+    volatile unsigned head;          //!< Relative buffer head
+    unsigned parse;                  //!< Start of bytes not yet parsed into packets (RX)
+    volatile unsigned tail;          //!< Relative buffer tail
     // the tail should never point to byte that contains data
 } uartBuf_t;
 
+/**
+ * @brief       Read an unaligned little-endian 16-bit field from a packet
+ */
+static inline uint16_t uartPkt_u16(uartPkt_t *pkt, unsigned offset)
+{
+    return ((uint16_t)pkt->data[offset + 1] << 8) | pkt->data[offset];
+}
+
+/**
+ * @brief       Read an unaligned little-endian 32-bit field from a packet
+ */
+static inline uint32_t uartPkt_u32(uartPkt_t *pkt, unsigned offset)
+{
+    return ((uint32_t)uartPkt_u16(pkt, offset + 2) << 16) | uartPkt_u16(pkt, offset);
+}
+
 typedef enum {
     UART_STATUS_TX_BUSY = 0x01,
     UART_STATUS_RX_BUSY = 0x02,
 } uart_status_t;
 
 extern volatile unsigned host_uart_status;
+extern volatile unsigned target_uart_status;
+
+/**
+ * @brief   Sequence ID written into the header of messages to host
+ * @details Set to the ID of the command being replied to, zero otherwise
+ *          (i.e. for stream data and other unsolicited messages).
+ */
+extern unsigned host_msg_seq;
+
+/**
+ * @brief   Tag written into the header of the next message to target
+ * @details Set by target_xact_begin for the request that starts a
+ *          transaction, and reset to zero once that message is sent. A
+ *          target that echoes the tag in its response lets late responses
+ *          (to a request that already timed out) be told apart.
+ */
+extern unsigned target_msg_tag;
+
+/**
+ * @brief   Counters of the health of the host link
+ */
+typedef struct {
+    uint16_t rx_msgs;           //!< messages received intact
+    uint16_t crc_errors;        //!< framed messages dropped due to a bad CRC
+    uint16_t framing_errors;    //!< framed messages dropped due to bad encoding or header
+    uint16_t resyncs;           //!< times bytes were skipped to find the next message
+    uint16_t rx_overruns;       //!< times the RX DMA overwrote unparsed bytes (ring resynced)
+} host_link_stats_t;
+
+extern host_link_stats_t host_link_stats;
+
+/**
+ * @brief   Callback for when a message to the host has been sent
+ * @param   buf     The buffer that was passed to UART_send_msg_to_host
+ *                  (the first segment for UART_send_segments_to_host)
+ * @details Called from the DMA ISR: the buffer may be reused after this.
+ */
+typedef void (uart_tx_complete_t)(uint8_t *buf);
+
+/**
+ * @brief   A piece of the payload of a message to host
+ */
+typedef struct {
+    const uint8_t *buf;
+    unsigned len;
+} uart_segment_t;
 
 /**
  * @brief       Set up UART
@@ -368,6 +298,10 @@ extern volatile unsigned host_uart_status;
  *              MSP430 on the USCI_A0 UART.  The WISP is connected
  *              on the USCI_A1 UART.  This function sets
  *              registers to configure either interface.
+ *
+ *              Bytes from the host are received by DMA into a ring (no
+ *              interrupt per byte), so the main loop polls the ring
+ *              with UART_RxBufEmpty.
  */
 void UART_setup(unsigned interface);
 
@@ -398,6 +332,9 @@ void UART_dropBufferBytes(unsigned interface, uint8_t *buf, unsigned len);
  * @brief       Construct a UART packet from the UART buffer
  * @param       interface   UART interface to use.  See @ref UART_INTERFACES
  * @param       pkt     Pointer to a uartPkt_t structure in which to store the message
+ * @details     Ring space held by the previous packet in pkt is released
+ *              here, once that packet has been marked as processed. The
+ *              packet is parsed in place: see uartPkt_t.
  * @retval      0       Packet construction succeeded
  * @retval      1       Packet construction failure
  * @retval      2       More data is needed to finish constructing the packet
@@ -405,32 +342,165 @@ void UART_dropBufferBytes(unsigned interface, uint8_t *buf, unsigned len);
 unsigned UART_buildRxPkt(unsigned interface, uartPkt_t *pkt);
 
 /**
- * @brief       Queue a UART message to be sent to the target
+ * @brief       Get the next command from the host
+ * @return      Pointer to the packet, or NULL if no complete command is pending
+ * @details     Commands are parsed ahead into a queue in the order received,
+ *              so that the host may keep several in flight (less than
+ *              UART_HOST_RX_RING_SIZE bytes). If the host sends more, the
+ *              overrun is counted in host_link_stats, and the commands not
+ *              yet returned are dropped along with the unparsed bytes. Each
+ *              returned packet must be marked as processed once handled; its
+ *              ring space is released on a later call.
+ */
+uartPkt_t *UART_next_host_cmd();
+
+/**
+ * @brief       Get the command UART_next_host_cmd would return, without
+ *              returning it
+ * @details     For the caller to decide whether to execute it now.
+ */
+uartPkt_t *UART_peek_host_cmd();
+
+/**
+ * @brief       Start sending a UART message to the target
  * @param       descriptor  Message descriptor.  See @ref target_comm.h
- * @param       data        Pointer to the data to send
- * @param       data_len    Length of the data to send
- * @warning     As it is currently implemented, this function will block until
- *              the entire message is written to the software buffer.
+ * @param       data        Complete msg buffer: UART_MSG_HEADER_SIZE bytes
+ *                          for the header, followed by the payload
+ * @param       data_len    Length of the payload
+ * @details     The message is sent straight from the buffer, by DMA if
+ *              DMA_TARGET_UART_TX is assigned, otherwise by the TX ISR. Waits
+ *              only for the previous message to be sent. The buffer must not
+ *              be modified while the TX busy status is set in
+ *              target_uart_status; FLAG_UART_WISP_TX is raised once it clears.
  */
 void UART_send_msg_to_target(unsigned descriptor, unsigned data_len, uint8_t *data);
 
+/**
+ * @brief   Handle completion of a target TX transfer
+ * @details Called from the DMA ISR (or the UART TX ISR without DMA).
+ */
+void UART_target_tx_complete();
+
 /**
  * @brief   Send message to host via UART
- * @param   buf             Complete msg buffer (including space for header
- * @param   payload_len     Number of bytes in payload data (excludes msg header)
- * @details This function will fill in the payload length field in the header.
- *          Waits for UART to become available, and returns after setting up
- *          the DMA request.
+ * @param   buf             Payload of the message (no space for the header)
+ * @param   payload_len     Number of bytes in payload data (excludes msg header),
+ *                          at most UART_host_max_payload_len()
+ * @param   on_complete     Called when the buffer is no longer in use (may be NULL)
+ * @details Same as UART_send_segments_to_host with a single segment.
+ */
+void UART_send_msg_to_host(unsigned descriptor, unsigned payload_len, uint8_t *buf,
+                           uart_tx_complete_t *on_complete);
+
+/**
+ * @brief   Send message to host with a payload gathered from several buffers
+ * @param   segments        Pieces of the payload, in order (may be empty)
+ * @param   count           Number of segments, less than UART_HOST_TX_QUEUE_LEN
+ * @param   on_complete     Called with segments[0].buf when none of the
+ *                          segments are in use anymore (may be NULL)
+ * @details The header, in the variant negotiated for the session (see
+ *          HOST_LINK_EXT_LEN), is kept in a buffer owned by the TX queue, so
+ *          producers need not reserve space for it in front of the payload.
+ *          Queues one DMA descriptor for the header and one per segment, and
+ *          returns without waiting for the transfer: the DMA ISR chains queued
+ *          descriptors one after another. Only waits if the descriptor queue
+ *          is full. The segments must not be modified until on_complete is
+ *          called; the segment array itself may be reused on return.
+ *          In framed mode, the message is encoded into the frame buffer and
+ *          on_complete is called before returning.
+ */
+void UART_send_segments_to_host(unsigned descriptor,
+                                const uart_segment_t *segments, unsigned count,
+                                uart_tx_complete_t *on_complete);
+
+/**
+ * @brief   Forward the data of a packet from the target to the host
+ * @param   pkt     Packet returned by UART_buildRxPkt for the target interface
+ * @details The data is sent straight out of the target RX ring, without a
+ *          copy. The ring space of the packet stays held until the transfer
+ *          completes, even after the packet is marked as processed: the
+ *          target RX ISR drops bytes rather than overwrite it.
+ */
+void UART_forward_target_pkt(unsigned descriptor, uartPkt_t *pkt);
+
+/**
+ * @brief   Max payload length of a message to host in the current session
+ * @details 255 bytes with the basic header, 64 KB with the extended header.
+ *          In framed mode, the encoded message must also fit in the frame
+ *          buffer.
+ */
+unsigned UART_host_max_payload_len();
+
+/**
+ * @brief   Count a wrap of the host RX DMA channel around the ring
+ * @details Called from the DMA ISR.
+ */
+void UART_host_rx_wrapped();
+
+/**
+ * @brief   Handle completion of a host TX DMA transfer
+ * @details Called from the DMA ISR. Starts the next queued descriptor and
+ *          invokes the completion callback of the finished one.
+ */
+void UART_host_tx_complete();
+
+/**
+ * @brief   Host link options supported by this build (see host_link_flag_t)
+ */
+#ifdef CONFIG_HOST_UART_FRAMING
+#define UART_HOST_LINK_SUPPORTED                (HOST_LINK_FRAMED | HOST_LINK_EXT_LEN)
+#else
+#define UART_HOST_LINK_SUPPORTED                HOST_LINK_EXT_LEN
+#endif
+
+/**
+ * @brief   Set the options of the host link
+ * @param   flags   Bitmask of options in UART_HOST_LINK_SUPPORTED
+ * @details Messages queued before this call are sent with the old options.
+ *          Resets the link stats.
+ */
+void UART_set_host_link(unsigned flags);
+
+/**
+ * @brief   Check whether the host UART can run at a baudrate
+ * @return  0 if supported, 1 if out of range or the divisor error exceeds
+ *          CONFIG_UART_MAX_BAUD_ERROR_PPM
+ */
+unsigned UART_check_host_baudrate(uint32_t baud);
+
+/**
+ * @brief   Switch the host UART to a baudrate
+ * @return  Same as UART_check_host_baudrate
+ * @details Blocks until the messages queued so far have been sent at the
+ *          old rate. The old rate is kept for UART_revert_host_baudrate.
+ */
+unsigned UART_set_host_baudrate(uint32_t baud);
+
+/**
+ * @brief   Switch the host UART back to the rate before the last switch
+ */
+void UART_revert_host_baudrate();
+
+/**
+ * @brief   Check whether the target UART can run at a baudrate
+ * @return  0 if supported, 1 if above CONFIG_TARGET_UART_MAX_BAUDRATE, out
+ *          of range or the divisor error exceeds CONFIG_UART_MAX_BAUD_ERROR_PPM
+ */
+unsigned UART_check_target_baudrate(uint32_t baud);
+
+/**
+ * @brief   Switch the target UART to a baudrate
+ * @return  Same as UART_check_target_baudrate
+ * @details Blocks until the message in flight has been sent at the old rate.
+ *          The old rate is kept for UART_revert_target_baudrate. UART_setup
+ *          always starts the target link at CONFIG_TARGET_UART_BAUDRATE.
  */
-void UART_send_msg_to_host(unsigned descriptor, unsigned payload_len, uint8_t *buf);
+unsigned UART_set_target_baudrate(uint32_t baud);
 
 /**
- * @brief   Wraps transmissions (incl. buffer filling) to serialize them
- * @details Waits for DMA to complete and therefore "release" the buffer
- *          in use by the previous transmission.
+ * @brief   Switch the target UART back to the rate before the last switch
  */
-void UART_begin_transmission();
-void UART_end_transmission();
+void UART_revert_target_baudrate();
 
 /**
  * @brief       Determine whether a software UART RX buffer is empty
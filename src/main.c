@@ -31,6 +31,28 @@
 #include "interrupt.h"
 #include "sched.h"
 #include "delay.h"
+#include "stream.h"
+#include "target_xact.h"
+#include "mem_dump.h"
+#include "mem_write.h"
+#include "mem_crc.h"
+#include "mem_gather.h"
+
+#ifdef CONFIG_TARGET_MEM_CACHE
+#include "mem_cache.h"
+#endif
+
+#ifdef CONFIG_DEBUG_MODE_SNAPSHOT
+#include "snapshot.h"
+#endif
+
+#ifdef CONFIG_TARGET_STDIO_COALESCE
+#include "target_stdio.h"
+#endif
+
+#ifdef CONFIG_PERIODIC_PAYLOAD
+#include "payload.h"
+#endif
 
 #ifdef CONFIG_PWM_CHARGING
 #include "pwm.h"
@@ -79,8 +101,23 @@ static sig_cmd_t target_sig_cmd;
 
 static interrupt_context_t interrupt_context;
 
+#ifdef CONFIG_RICH_INTERRUPT_CONTEXT
+// Range of target memory sent with the context (e.g. top of the stack)
+static uint32_t context_window_address;
+static unsigned context_window_len = 0;
+static uint32_t context_pc;
+#endif // CONFIG_RICH_INTERRUPT_CONTEXT
+
 #ifdef CONFIG_HOST_UART
-static uartPkt_t usbRxPkt = { .processed = 1 };
+// Sequence IDs of commands whose replies are sent later from the main loop
+static unsigned debug_mode_cmd_seq = 0;
+static unsigned charger_cmd_seq = 0;
+
+// Batch of host commands being executed, and offset of its next command
+static uartPkt_t *batch_pkt = NULL;
+static unsigned batch_offset;
+
+static void run_batch();
 #endif
 
 static void set_state(state_t new_state)
@@ -242,6 +279,16 @@ static sched_cmd_t on_exit_debug_mode_timeout()
 #endif// CONFIG_ENABLE_DEBUG_MODE_TIMEOUTS
 #endif // CONFIG_ENABLE_DEBUG_MODE
 
+#ifdef CONFIG_HOST_UART_BAUDRATE_NEGOTIATION
+static bool host_baudrate_probe_pending = false;
+
+static sched_cmd_t on_host_baudrate_probe_timeout()
+{
+    main_loop_flags |= FLAG_HOST_BAUDRATE_FALLBACK;
+    return SCHED_CMD_WAKEUP;
+}
+#endif // CONFIG_HOST_UART_BAUDRATE_NEGOTIATION
+
 #ifdef CONFIG_ENABLE_DEBUG_MODE
 void enter_debug_mode(interrupt_type_t int_type, unsigned flags)
 {
@@ -279,6 +326,10 @@ void exit_debug_mode()
 
     // interrupt_context cleared after the target acks the exit request
 
+#ifdef CONFIG_TARGET_MEM_CACHE
+    mem_cache_invalidate();
+#endif
+
 #ifdef CONFIG_ENABLE_DEBUG_MODE_TIMEOUTS
     schedule_action(on_exit_debug_mode_timeout, CONFIG_EXIT_DEBUG_MODE_TIMEOUT);
 #endif // CONFIG_ENABLE_DEBUG_MODE_TIMEOUTS
@@ -322,16 +373,87 @@ return_code_t interrupt_target()
 }
 
 #ifdef CONFIG_FETCH_INTERRUPT_CONTEXT
-static void get_target_interrupt_context(interrupt_context_t *int_context)
+static void parse_target_interrupt_context(uartPkt_t *rsp, interrupt_context_t *int_context)
 {
-    // In case target requested the interrupt, ask it for more details
-    target_comm_send_get_interrupt_context();
-    while((UART_buildRxPkt(UART_INTERFACE_WISP, &wispRxPkt) != 0) ||
-            (wispRxPkt.descriptor != WISP_RSP_INTERRUPT_CONTEXT)); // wait for response
-    int_context->type = (interrupt_type_t)wispRxPkt.data[0];
-    int_context->id = ((uint16_t)wispRxPkt.data[2] << 8) | wispRxPkt.data[1];
-    wispRxPkt.processed = 1;
+    int_context->type = (interrupt_type_t)rsp->data[0];
+    int_context->id = ((uint16_t)rsp->data[2] << 8) | rsp->data[1];
 }
+
+#ifdef CONFIG_RICH_INTERRUPT_CONTEXT
+static void on_context_window_rsp(uartPkt_t *rsp, unsigned arg)
+{
+    if (!rsp || rsp->length != context_window_len) {
+        LOG("no context window from target\r\n");
+        return;
+    }
+
+    send_interrupt_context_ext(&interrupt_context, context_pc,
+                               context_window_address, rsp->data, rsp->length);
+}
+
+static void on_context_pc_rsp(uartPkt_t *rsp, unsigned arg)
+{
+    unsigned i;
+
+    if (!rsp) {
+        LOG("no context pc from target\r\n");
+        return;
+    }
+
+    context_pc = 0;
+    for (i = 0; i < rsp->length && i < sizeof(uint32_t); ++i)
+        context_pc |= (uint32_t)rsp->data[i] << (8 * i);
+
+    if (context_window_len == 0) {
+        send_interrupt_context_ext(&interrupt_context, context_pc,
+                                   context_window_address, NULL, 0);
+        return;
+    }
+
+    ASSERT(ASSERT_TARGET_XACT_BUSY, !target_xact_pending());
+    target_xact_begin(WISP_RSP_MEMORY, CONFIG_TARGET_XACT_TIMEOUT,
+                      on_context_window_rsp, 0);
+    target_comm_send_read_mem(context_window_address, context_window_len);
+}
+#endif // CONFIG_RICH_INTERRUPT_CONTEXT
+
+// Notify the host, with the details from the target if it replied (rsp != NULL)
+static void on_interrupted_target_context(uartPkt_t *rsp, unsigned arg)
+{
+    if (rsp)
+        parse_target_interrupt_context(rsp, &interrupt_context);
+
+#ifdef CONFIG_HOST_UART
+    LOG("sending int context to host\r\n");
+    send_interrupt_context(&interrupt_context);
+
+#ifdef CONFIG_RICH_INTERRUPT_CONTEXT
+    // The extended context follows, once the target replies
+    if (debug_mode_flags & DEBUG_MODE_WITH_UART) {
+        ASSERT(ASSERT_TARGET_XACT_BUSY, !target_xact_pending());
+        target_xact_begin(WISP_RSP_ADDRESS, CONFIG_TARGET_XACT_TIMEOUT,
+                          on_context_pc_rsp, 0);
+        target_comm_send_get_pc();
+    }
+#endif // CONFIG_RICH_INTERRUPT_CONTEXT
+#endif // CONFIG_HOST_UART
+}
+
+#ifdef CONFIG_HOST_UART
+// Reply to host request for the context of a target-initiated interrupt
+static void on_target_interrupt_context(uartPkt_t *rsp, unsigned arg)
+{
+    interrupt_context_t target_int_context;
+
+    if (!rsp) {
+        send_return_code(RETURN_CODE_COMM_ERROR);
+        return;
+    }
+
+    parse_target_interrupt_context(rsp, &target_int_context);
+    send_interrupt_context(&target_int_context);
+}
+#endif // CONFIG_HOST_UART
 #endif // CONFIG_FETCH_INTERRUPT_CONTEXT
 
 static void finish_enter_debug_mode()
@@ -343,6 +465,10 @@ static void finish_enter_debug_mode()
     // WISP has entered debug main loop
     set_state(STATE_DEBUG);
 
+#ifdef CONFIG_TARGET_MEM_CACHE
+    mem_cache_invalidate(); // target ran since the last stop
+#endif
+
 #ifdef CONFIG_DEBUG_MODE_LED
     GPIO(PORT_LED_DEBUG_MODE, OUT) |= BIT(PIN_LED_DEBUG_MODE);
 #endif // CONFIG_DEBUG_MODE_LED
@@ -358,6 +484,11 @@ static void finish_enter_debug_mode()
     if (debug_mode_flags & DEBUG_MODE_INTERACTIVE)
           main_loop_flags |= FLAG_INTERRUPTED; // main loop notifies the host
 
+#ifdef CONFIG_DEBUG_MODE_SNAPSHOT
+    if (debug_mode_flags & DEBUG_MODE_WITH_UART)
+        main_loop_flags |= FLAG_SNAPSHOT; // after the host is notified
+#endif
+
 #ifdef CONFIG_ENABLE_TARGET_SIDE_DEBUG_MODE
     reset_serial_decoder();
     unmask_target_signal(); // listen because target *may* request to exit active debug mode
@@ -371,6 +502,10 @@ static void finish_exit_debug_mode()
     abort_action(on_exit_debug_mode_timeout);
 #endif // CONFIG_ENABLE_DEBUG_MODE_TIMEOUTS
 
+#ifdef CONFIG_TARGET_MEM_CACHE
+    mem_cache_invalidate(); // also when the target asked to resume
+#endif
+
     // WISP has shutdown UART and is asleep waiting for int to resume
 #if 0 // TODO: this breaks edb after a few printfs, the only danger of not tearing UART down
       // is energy interference due to the pins being high, but hopefully this is negligible
@@ -651,6 +786,166 @@ void break_at_vcap_level_cmp(uint16_t level, comparator_ref_t ref)
 #endif // CONFIG_ENABLE_DEBUG_MODE
 
 #ifdef CONFIG_HOST_UART
+#ifdef CONFIG_ENABLE_DEBUG_MODE
+// Completion of requests to target made by host commands
+
+static void on_target_address_rsp(uartPkt_t *rsp, unsigned arg)
+{
+    if (rsp)
+        UART_forward_target_pkt(USB_RSP_ADDRESS, rsp);
+    else
+        send_return_code(RETURN_CODE_COMM_ERROR);
+}
+
+#ifndef CONFIG_TARGET_MEM_CACHE // otherwise, reads go through the cache
+static void on_target_read_mem_rsp(uartPkt_t *rsp, unsigned arg)
+{
+    if (rsp)
+        UART_forward_target_pkt(USB_RSP_WISP_MEMORY, rsp);
+    else
+        send_return_code(RETURN_CODE_COMM_ERROR);
+}
+#endif // !CONFIG_TARGET_MEM_CACHE
+
+static void on_target_write_mem_rsp(uartPkt_t *rsp, unsigned arg)
+{
+    // TODO: have WISP return a code
+    send_return_code(rsp ? RETURN_CODE_SUCCESS : RETURN_CODE_COMM_ERROR);
+}
+
+#ifdef CONFIG_ENABLE_TARGET_SIDE_DEBUG_MODE
+/**
+ * @brief   Send an echo request to target, and decode the value that the
+ *          target signals back on the serial bit stream
+ * @details The target replies on both the signal line and UART. The signal
+ *          ISR decodes the bit stream and restores the state once it ends;
+ *          the UART response completes the transaction begun by the caller,
+ *          whose callback calls serial_echo_end.
+ */
+static void serial_echo_begin(unsigned value)
+{
+    saved_sig_serial_echo_state = state;
+    set_state(STATE_SERIAL_ECHO);
+
+    reset_serial_decoder();
+
+    sig_serial_echo_value = 0;
+    unmask_target_signal();
+
+    target_comm_send_echo(value);
+}
+
+/**
+ * @brief   Finish a serial echo, whether or not the bit stream ended
+ * @return  Decoded value (partial if the bit stream did not end)
+ */
+static unsigned serial_echo_end()
+{
+    uint16_t sr;
+
+    sr = __get_SR_register();
+    __disable_interrupt(); // the signal ISR may be ending the bit stream
+    if (state == STATE_SERIAL_ECHO) {
+        stop_serial_decoder();
+        set_state(saved_sig_serial_echo_state);
+    }
+    __bis_SR_register(sr & GIE); // restore the caller's interrupt state
+
+    return sig_serial_echo_value;
+}
+#endif // CONFIG_ENABLE_TARGET_SIDE_DEBUG_MODE
+
+#ifdef CONFIG_TARGET_UART_BAUDRATE_NEGOTIATION
+#ifndef CONFIG_ENABLE_TARGET_SIDE_DEBUG_MODE
+#error CONFIG_TARGET_UART_BAUDRATE_NEGOTIATION: probe requires CONFIG_ENABLE_TARGET_SIDE_DEBUG_MODE
+#endif
+
+static uint32_t target_baudrate_pending;
+
+// The probe is a serial echo: the target answers it over UART at the new
+// rate, which is proof enough that both ends switched
+static void on_target_baudrate_probe_rsp(uartPkt_t *rsp, unsigned arg)
+{
+    serial_echo_end();
+
+    if (rsp) {
+        send_return_code(RETURN_CODE_SUCCESS);
+        return;
+    }
+
+    // Target falls back too, unless it got the probe: then the link is
+    // lost until the next debug mode session, which starts at the safe rate.
+    UART_revert_target_baudrate();
+    send_return_code(RETURN_CODE_COMM_ERROR);
+}
+
+// Target acked the request at the old rate and is switching
+static void on_target_baudrate_rsp(uartPkt_t *rsp, unsigned arg)
+{
+    if (!rsp) {
+        send_return_code(RETURN_CODE_COMM_ERROR);
+        return;
+    }
+
+    UART_set_target_baudrate(target_baudrate_pending);
+
+    ASSERT(ASSERT_TARGET_XACT_BUSY, !target_xact_pending());
+    target_xact_begin(WISP_RSP_SERIAL_ECHO, CONFIG_TARGET_XACT_TIMEOUT,
+                      on_target_baudrate_probe_rsp, 0);
+    serial_echo_begin(CONFIG_TARGET_BAUDRATE_PROBE_VALUE);
+}
+#endif // CONFIG_TARGET_UART_BAUDRATE_NEGOTIATION
+#endif // CONFIG_ENABLE_DEBUG_MODE
+
+#ifdef CONFIG_ENABLE_TARGET_SIDE_DEBUG_MODE
+static void on_target_serial_echo_rsp(uartPkt_t *rsp, unsigned value)
+{
+    serial_echo_end();
+
+    if (rsp)
+        send_echo(value);
+    else
+        send_return_code(RETURN_CODE_COMM_ERROR);
+}
+#endif // CONFIG_ENABLE_TARGET_SIDE_DEBUG_MODE
+
+#ifdef CONFIG_TARGET_UART
+/**
+ * @brief       Whether a host command must wait for the pending target request
+ * @details     True for commands that make requests to the target, or change
+ *              the target link or debug mode state that a pending request
+ *              relies on. A batch may contain any command, so it waits too.
+ */
+static bool host_cmd_needs_target(unsigned descriptor)
+{
+    switch (descriptor) {
+    case USB_CMD_ENTER_ACTIVE_DEBUG:
+    case USB_CMD_EXIT_ACTIVE_DEBUG:
+    case USB_CMD_INTERRUPT:
+    case USB_CMD_GET_WISP_PC:
+    case USB_CMD_SET_TARGET_BAUDRATE:
+    case USB_CMD_SET_CONTEXT_WINDOW:
+    case USB_CMD_GET_INTERRUPT_CONTEXT:
+    case USB_CMD_READ_MEM:
+    case USB_CMD_WRITE_MEM:
+    case USB_CMD_WRITE_MEM_BULK:
+    case USB_CMD_WRITE_MEM_BULK_DATA:
+    case USB_CMD_DUMP_MEM:
+    case USB_CMD_CRC_MEM:
+    case USB_CMD_READ_MEM_GATHER:
+    case USB_CMD_SNAPSHOT_REGION:
+    case USB_CMD_BREAKPOINT:
+    case USB_CMD_SERIAL_ECHO:
+    case USB_CMD_ENABLE_TARGET_UART:
+    case USB_CMD_RESET_STATE:
+    case USB_CMD_BATCH:
+        return true;
+    default:
+        return false;
+    }
+}
+#endif // CONFIG_TARGET_UART
+
 /**
  * @brief       Execute a command received from the computer through the USB port
  * @param       pkt     Packet structure that contains the received message info
@@ -677,12 +972,12 @@ static void executeUSBCmd(uartPkt_t *pkt)
         }
 #ifdef CONFIG_PWM_CHARGING
     case USB_CMD_SET_VCAP:
-        adc12Target = *((uint16_t *)(pkt->data));
+        adc12Target = uartPkt_u16(pkt, 0);
         setWispVoltage_block(ADC_CHAN_INDEX_VCAP, adc12Target);
         break;
 
     case USB_CMD_SET_VBOOST:
-        adc12Target = *((uint16_t *)(pkt->data));
+        adc12Target = uartPkt_u16(pkt, 0);
         setWispVoltage_block(ADC_CHAN_INDEX_VBOOST, adc12Target);
         break;
 #endif
@@ -690,14 +985,17 @@ static void executeUSBCmd(uartPkt_t *pkt)
 #ifdef CONFIG_ENABLE_DEBUG_MODE
     case USB_CMD_ENTER_ACTIVE_DEBUG:
     	// todo: turn off all logging?
+        debug_mode_cmd_seq = pkt->seq;
         enter_debug_mode(INTERRUPT_TYPE_DEBUGGER_REQ, DEBUG_MODE_FULL_FEATURES);
         break;
 
     case USB_CMD_EXIT_ACTIVE_DEBUG:
+        debug_mode_cmd_seq = pkt->seq;
         exit_debug_mode();
         break;
 
     case USB_CMD_INTERRUPT: {
+        debug_mode_cmd_seq = pkt->seq;
         return_code_t rc = interrupt_target();
         if (rc != RETURN_CODE_SUCCESS)
             send_return_code(rc);
@@ -706,24 +1004,66 @@ static void executeUSBCmd(uartPkt_t *pkt)
     }
 
     case USB_CMD_GET_WISP_PC:
+        if (target_xact_begin(WISP_RSP_ADDRESS, CONFIG_TARGET_XACT_TIMEOUT,
+                              on_target_address_rsp, 0) != RETURN_CODE_SUCCESS) {
+            send_return_code(RETURN_CODE_BUSY);
+            break;
+        }
         target_comm_send_get_pc();
-    	while((UART_buildRxPkt(UART_INTERFACE_WISP, &wispRxPkt) != 0) ||
-    			(wispRxPkt.descriptor != WISP_RSP_ADDRESS)); // wait for response
-        forward_msg_to_host(USB_RSP_ADDRESS, wispRxPkt.data, wispRxPkt.length);
-    	wispRxPkt.processed = 1;
-    	break;
+        break;
+
+#ifdef CONFIG_TARGET_UART_BAUDRATE_NEGOTIATION
+    case USB_CMD_SET_TARGET_BAUDRATE:
+    {
+        uint32_t baudrate = uartPkt_u32(pkt, 0);
+
+        if (state != STATE_DEBUG || UART_check_target_baudrate(baudrate)) {
+            send_return_code(RETURN_CODE_UNSUPPORTED);
+            break;
+        }
+
+        // reply once the target has switched and answered a probe
+        if (target_xact_begin(WISP_RSP_BAUDRATE, CONFIG_TARGET_XACT_TIMEOUT,
+                              on_target_baudrate_rsp, 0) != RETURN_CODE_SUCCESS) {
+            send_return_code(RETURN_CODE_BUSY);
+            break;
+        }
+        target_baudrate_pending = baudrate;
+        target_comm_send_set_baudrate(baudrate);
+        break;
+    }
+#endif // CONFIG_TARGET_UART_BAUDRATE_NEGOTIATION
+
+#ifdef CONFIG_RICH_INTERRUPT_CONTEXT
+    case USB_CMD_SET_CONTEXT_WINDOW:
+    {
+        unsigned len = pkt->data[4];
+
+        if (len > CONFIG_CONTEXT_WINDOW_MAX_LEN) {
+            send_return_code(RETURN_CODE_BUFFER_TOO_SMALL);
+            break;
+        }
+
+        context_window_address = uartPkt_u32(pkt, 0);
+        context_window_len = len;
+        send_return_code(RETURN_CODE_SUCCESS);
+        break;
+    }
+#endif // CONFIG_RICH_INTERRUPT_CONTEXT
 #endif // CONFIG_ENABLE_DEBUG_MODE
 
     case USB_CMD_STREAM_BEGIN: {
         uint16_t streams = pkt->data[0];
 #ifdef CONFIG_ENABLE_VOLTAGE_STREAM
-        unsigned sampling_period = (pkt->data[2] << 8) | pkt->data[1];
+        unsigned sampling_period = uartPkt_u16(pkt, 1);
 #endif
 
 #ifdef CONFIG_SYSTICK
         systick_reset(); // to avoid timestamp wrap-around in middle of stream
 #endif
 
+        stream_reset_drops(streams);
+
 #ifdef CONFIG_ENABLE_RF_PROTOCOL_MONITORING
         if (streams & STREAM_RF_EVENTS)
             RFID_start_event_stream();
@@ -734,8 +1074,11 @@ static void executeUSBCmd(uartPkt_t *pkt)
 #ifdef CONFIG_ENABLE_VOLTAGE_STREAM
         // actions common to all adc streams
         if (streams & ADC_STREAMS) {
-            main_loop_flags |= FLAG_LOGGING; // for main loop
-            ADC_start(streams & ADC_STREAMS, sampling_period);
+            return_code_t rc = ADC_start(streams & ADC_STREAMS, sampling_period);
+            if (rc == RETURN_CODE_SUCCESS)
+                main_loop_flags |= FLAG_LOGGING; // for main loop
+            else
+                send_return_code(rc);
         }
 #endif
         break;
@@ -761,6 +1104,13 @@ static void executeUSBCmd(uartPkt_t *pkt)
         break;
     }
 
+    case USB_CMD_STREAM_CREDIT: {
+        uint16_t streams = pkt->data[0];
+        uint16_t credits = uartPkt_u16(pkt, 1);
+        stream_grant_credits(streams, credits);
+        break;
+    }
+
     case USB_CMD_SEND_RF_TX_DATA:
 		// not implemented
 		break;
@@ -780,27 +1130,29 @@ static void executeUSBCmd(uartPkt_t *pkt)
 #endif
 
     case USB_CMD_CHARGE:
-        target_vcap = *((uint16_t *)(&pkt->data[0]));
+        target_vcap = uartPkt_u16(pkt, 0);
         actual_vcap = charge_adc(target_vcap);
         send_voltage(actual_vcap);
         break;
 
     case USB_CMD_DISCHARGE:
-        target_vcap = *((uint16_t *)(pkt->data));
+        target_vcap = uartPkt_u16(pkt, 0);
         actual_vcap = discharge_adc(target_vcap);
         send_voltage(actual_vcap);
         break;
 
     case USB_CMD_CHARGE_CMP: {
-        target_vcap = *((uint16_t *)(pkt->data));
+        target_vcap = uartPkt_u16(pkt, 0);
         comparator_ref_t cmp_ref = (comparator_ref_t)pkt->data[2];
+        charger_cmd_seq = pkt->seq;
         charge_cmp(target_vcap, cmp_ref);
         break;
     }
 
     case USB_CMD_DISCHARGE_CMP: {
-        target_vcap = *((uint16_t *)(pkt->data));
+        target_vcap = uartPkt_u16(pkt, 0);
         comparator_ref_t cmp_ref = (comparator_ref_t)pkt->data[2];
+        charger_cmd_seq = pkt->seq;
         discharge_cmp(target_vcap, cmp_ref);
         break;
     }
@@ -818,11 +1170,11 @@ static void executeUSBCmd(uartPkt_t *pkt)
     	break;
 
     case USB_CMD_SET_PWM_FREQUENCY:
-        PWM_set_freq((*((uint16_t *)(pkt->data))) - 1);
+        PWM_set_freq(uartPkt_u16(pkt, 0) - 1);
     	break;
 
     case USB_CMD_SET_PWM_DUTY_CYCLE:
-        PWM_set_duty_cycle(*((uint16_t *)(pkt->data)));
+        PWM_set_duty_cycle(uartPkt_u16(pkt, 0));
     	break;
 
     case USB_CMD_PWM_HIGH:
@@ -840,7 +1192,7 @@ static void executeUSBCmd(uartPkt_t *pkt)
 
 #ifdef CONFIG_ENABLE_DEBUG_MODE
     case USB_CMD_BREAK_AT_VCAP_LEVEL: {
-        target_vcap = *((uint16_t *)(&pkt->data[0]));
+        target_vcap = uartPkt_u16(pkt, 0);
         energy_breakpoint_impl_t impl = (energy_breakpoint_impl_t)pkt->data[2];
         switch (impl) {
             case ENERGY_BREAKPOINT_IMPL_ADC:
@@ -857,20 +1209,27 @@ static void executeUSBCmd(uartPkt_t *pkt)
 
     case USB_CMD_READ_MEM:
     {
-        uint32_t address = *((uint32_t *)(&pkt->data[0]));
+        uint32_t address = uartPkt_u32(pkt, 0);
         unsigned len = pkt->data[4];
 
+#ifdef CONFIG_TARGET_MEM_CACHE
+        return_code_t rc = mem_cache_read(address, len);
+        if (rc != RETURN_CODE_SUCCESS)
+            send_return_code(rc);
+#else // !CONFIG_TARGET_MEM_CACHE
+        if (target_xact_begin(WISP_RSP_MEMORY, CONFIG_TARGET_XACT_TIMEOUT,
+                              on_target_read_mem_rsp, 0) != RETURN_CODE_SUCCESS) {
+            send_return_code(RETURN_CODE_BUSY);
+            break;
+        }
         target_comm_send_read_mem(address, len);
-        while((UART_buildRxPkt(UART_INTERFACE_WISP, &wispRxPkt) != 0) ||
-                (wispRxPkt.descriptor != WISP_RSP_MEMORY)); // wait for response
-        forward_msg_to_host(USB_RSP_WISP_MEMORY, wispRxPkt.data, wispRxPkt.length);
-        wispRxPkt.processed = 1;
+#endif // !CONFIG_TARGET_MEM_CACHE
         break;
     }
 
     case USB_CMD_WRITE_MEM:
     {
-        uint32_t address = *((uint32_t *)(&pkt->data[0]));
+        uint32_t address = uartPkt_u32(pkt, 0);
         unsigned len = pkt->data[4];
         uint8_t *value = &pkt->data[5];
 
@@ -879,12 +1238,96 @@ static void executeUSBCmd(uartPkt_t *pkt)
             break;
         }
 
+        if (target_xact_begin(WISP_RSP_MEMORY, CONFIG_TARGET_XACT_TIMEOUT,
+                              on_target_write_mem_rsp, 0) != RETURN_CODE_SUCCESS) {
+            send_return_code(RETURN_CODE_BUSY);
+            break;
+        }
+
+#ifdef CONFIG_TARGET_MEM_CACHE
+        mem_cache_invalidate();
+#endif
+
         target_comm_send_write_mem(address, value, len);
-        while((UART_buildRxPkt(UART_INTERFACE_WISP, &wispRxPkt) != 0) ||
-                (wispRxPkt.descriptor != WISP_RSP_MEMORY)); // wait for response
-        wispRxPkt.processed = 1;
+        break;
+    }
 
-        send_return_code(RETURN_CODE_SUCCESS); // TODO: have WISP return a code
+#ifdef CONFIG_DEBUG_MODE_SNAPSHOT
+    case USB_CMD_SNAPSHOT_REGION:
+    {
+        unsigned index = pkt->data[0];
+        uint32_t address = uartPkt_u32(pkt, 1);
+        unsigned len = uartPkt_u16(pkt, 5);
+
+        send_return_code(snapshot_set_region(index, address, len));
+        break;
+    }
+#endif // CONFIG_DEBUG_MODE_SNAPSHOT
+
+    case USB_CMD_DUMP_MEM:
+    {
+        uint32_t address = uartPkt_u32(pkt, 0);
+        uint32_t len = uartPkt_u32(pkt, 4);
+
+        return_code_t rc = mem_dump_start(address, len);
+        if (rc != RETURN_CODE_SUCCESS)
+            send_return_code(rc);
+        // otherwise, the return code follows the dumped memory
+        break;
+    }
+
+    case USB_CMD_CRC_MEM:
+    {
+        uint32_t address = uartPkt_u32(pkt, 0);
+        uint32_t len = uartPkt_u32(pkt, 4);
+        uint32_t block_len = uartPkt_u32(pkt, 8);
+
+        return_code_t rc = mem_crc_start(address, len, block_len);
+        if (rc != RETURN_CODE_SUCCESS)
+            send_return_code(rc);
+        // otherwise, the return code follows the CRCs
+        break;
+    }
+
+    case USB_CMD_READ_MEM_GATHER:
+    {
+        // list of (address (uint32), length (uint8))
+        if (pkt->length % (sizeof(uint32_t) + sizeof(uint8_t))) {
+            send_return_code(RETURN_CODE_INVALID_ARGS);
+            break;
+        }
+
+        return_code_t rc = mem_gather_start(pkt->data,
+                pkt->length / (sizeof(uint32_t) + sizeof(uint8_t)));
+        if (rc != RETURN_CODE_SUCCESS)
+            send_return_code(rc);
+        // otherwise, the bytes are sent once all ranges are read
+        break;
+    }
+
+    case USB_CMD_WRITE_MEM_BULK:
+    case USB_CMD_WRITE_MEM_BULK_DATA:
+    {
+        // address and total length start the transfer, an offset continues it
+        unsigned header_len = pkt->descriptor == USB_CMD_WRITE_MEM_BULK ?
+            sizeof(uint32_t) + sizeof(uint16_t) : sizeof(uint16_t);
+        return_code_t rc;
+
+        if (pkt->length < header_len) {
+            send_return_code(RETURN_CODE_INVALID_ARGS);
+            break;
+        }
+
+        if (pkt->descriptor == USB_CMD_WRITE_MEM_BULK)
+            rc = mem_write_start(uartPkt_u32(pkt, 0), uartPkt_u16(pkt, 4),
+                                 &pkt->data[header_len], pkt->length - header_len);
+        else
+            rc = mem_write_append(uartPkt_u16(pkt, 0),
+                                  &pkt->data[header_len], pkt->length - header_len);
+        if (rc != RETURN_CODE_SUCCESS)
+            send_return_code(rc);
+        // otherwise, the return code is sent once the whole block is staged,
+        // written and verified
         break;
     }
 #endif // CONFIG_ENABLE_DEBUG_MODE
@@ -907,12 +1350,13 @@ static void executeUSBCmd(uartPkt_t *pkt)
     {
         breakpoint_type_t type = (breakpoint_type_t)pkt->data[0];
         unsigned index = (uint8_t)pkt->data[1];
-        uint16_t energy_level = *(uint16_t *)(&pkt->data[2]);
+        uint16_t energy_level = uartPkt_u16(pkt, 2);
         comparator_ref_t cmp_ref = (comparator_ref_t)pkt->data[4];
         bool enable = (bool)pkt->data[5];
         unsigned rc = toggle_breakpoint(type, index, energy_level,
                                         cmp_ref, enable);
-        send_return_code(rc);
+        if (rc != RETURN_CODE_NONE) // otherwise, sent once the target acks
+            send_return_code(rc);
         break;
     }
 
@@ -928,7 +1372,6 @@ static void executeUSBCmd(uartPkt_t *pkt)
 
 #ifdef CONFIG_ENABLE_DEBUG_MODE
     case USB_CMD_GET_INTERRUPT_CONTEXT: {
-        interrupt_context_t target_int_context;
         interrupt_source_t source = (interrupt_source_t)pkt->data[0];
 
         switch (source) {
@@ -936,8 +1379,13 @@ static void executeUSBCmd(uartPkt_t *pkt)
                 send_interrupt_context(&interrupt_context);
                 break;
             case INTERRUPT_SOURCE_TARGET:
-                get_target_interrupt_context(&target_int_context);
-                send_interrupt_context(&target_int_context);
+                // In case target requested the interrupt, ask it for more details
+                if (target_xact_begin(WISP_RSP_INTERRUPT_CONTEXT, CONFIG_TARGET_XACT_TIMEOUT,
+                                      on_target_interrupt_context, 0) != RETURN_CODE_SUCCESS) {
+                    send_return_code(RETURN_CODE_BUSY);
+                    break;
+                }
+                target_comm_send_get_interrupt_context();
                 break;
             default:
                 send_return_code(RETURN_CODE_INVALID_ARGS);
@@ -951,27 +1399,14 @@ static void executeUSBCmd(uartPkt_t *pkt)
     case USB_CMD_SERIAL_ECHO: {
         unsigned value = pkt->data[0];
 
-        saved_sig_serial_echo_state = state;
-        set_state(STATE_SERIAL_ECHO);
-
-        reset_serial_decoder();
-
-        sig_serial_echo_value = 0;
-        unmask_target_signal();
-
-        target_comm_send_echo(value);
-
-        // Wait while the ISRs decode the serial bit stream
-        volatile uint16_t timeout = 0xffff;
-        while (state == STATE_SERIAL_ECHO && --timeout > 0);
-        if (state == STATE_SERIAL_ECHO) // timeout
-            set_state(saved_sig_serial_echo_state);
-
-        while((UART_buildRxPkt(UART_INTERFACE_WISP, &wispRxPkt) != 0) ||
-                (wispRxPkt.descriptor != WISP_RSP_SERIAL_ECHO)); // wait for response
-        wispRxPkt.processed = 1;
+        // the echo is sent to host once the target also replies over UART
+        if (target_xact_begin(WISP_RSP_SERIAL_ECHO, CONFIG_TARGET_XACT_TIMEOUT,
+                              on_target_serial_echo_rsp, value) != RETURN_CODE_SUCCESS) {
+            send_return_code(RETURN_CODE_BUSY);
+            break;
+        }
 
-        send_echo(value);
+        serial_echo_begin(value);
         break;
     }
 #endif // CONFIG_ENABLE_DEBUG_MODE
@@ -994,7 +1429,7 @@ static void executeUSBCmd(uartPkt_t *pkt)
     }
 
     case USB_CMD_SET_PARAM: {
-        param_t param = (pkt->data[1] << 8) | pkt->data[0];
+        param_t param = uartPkt_u16(pkt, 0);
         return_code_t rc = set_param(param, &pkt->data[2]);
         send_return_code(rc);
         break;
@@ -1006,12 +1441,130 @@ static void executeUSBCmd(uartPkt_t *pkt)
         break;
     }
 
+    case USB_CMD_SET_HOST_LINK: {
+        unsigned flags = pkt->data[0];
+        if (flags & ~UART_HOST_LINK_SUPPORTED) {
+            send_return_code(RETURN_CODE_UNSUPPORTED);
+            break;
+        }
+        // Reply goes out in the old mode: it is encoded when queued
+        send_return_code(RETURN_CODE_SUCCESS);
+        UART_set_host_link(flags);
+        break;
+    }
+
+    case USB_CMD_GET_HOST_LINK_STATS:
+        send_host_link_stats();
+        break;
+
+#ifdef CONFIG_PERIODIC_PAYLOAD
+    case USB_CMD_PERIODIC_PAYLOAD: {
+        uint32_t period = uartPkt_u32(pkt, 0);
+        send_return_code(payload_set_period(period));
+        break;
+    }
+#endif // CONFIG_PERIODIC_PAYLOAD
+
+#ifdef CONFIG_TARGET_MEM_CACHE
+    case USB_CMD_GET_MEM_CACHE_STATS:
+        send_mem_cache_stats();
+        break;
+#endif // CONFIG_TARGET_MEM_CACHE
+
+#ifdef CONFIG_HOST_UART_BAUDRATE_NEGOTIATION
+    case USB_CMD_SET_BAUDRATE: {
+        uint32_t baudrate = uartPkt_u32(pkt, 0);
+        if (host_baudrate_probe_pending || UART_check_host_baudrate(baudrate)) {
+            send_return_code(RETURN_CODE_UNSUPPORTED);
+            break;
+        }
+        // Reply goes out at the old rate: the switch waits for TX to drain
+        send_return_code(RETURN_CODE_SUCCESS);
+        UART_set_host_baudrate(baudrate);
+        host_baudrate_probe_pending = true;
+        schedule_action(on_host_baudrate_probe_timeout, CONFIG_HOST_BAUDRATE_PROBE_TIMEOUT);
+        break;
+    }
+
+    case USB_CMD_BAUDRATE_PROBE:
+        if (host_baudrate_probe_pending) { // new rate works: keep it
+            abort_action(on_host_baudrate_probe_timeout);
+            host_baudrate_probe_pending = false;
+        }
+        if (pkt->length > HOST_MSG_BUF_SIZE) {
+            send_return_code(RETURN_CODE_INVALID_ARGS);
+            break;
+        }
+        forward_msg_to_host(USB_RSP_BAUDRATE_PROBE, pkt->data, pkt->length);
+        break;
+#endif // CONFIG_HOST_UART_BAUDRATE_NEGOTIATION
+
+    case USB_CMD_BATCH:
+        begin_batch();
+        batch_pkt = pkt;
+        batch_offset = 0;
+        run_batch();
+        return; // packet is marked processed once the batch is done
+
     default:
         break;
     }
 
     pkt->processed = 1;
 }
+
+/**
+ * @brief       Execute the commands of the batch in batch_pkt
+ * @details     Sub-commands are views into the batch payload and share its
+ *              sequence ID. Replies other than return codes are sent as
+ *              usual, before the combined reply with the return codes.
+ *
+ *              A sub-command that makes requests to the target returns
+ *              before its return code is known: the rest of the batch is
+ *              resumed from the main loop once the requests are done.
+ *              Sub-commands replied to from other main loop events (debug
+ *              mode, comparator charge) are not supported in a batch.
+ */
+static void run_batch()
+{
+    uartPkt_t *pkt = batch_pkt;
+    uartPkt_t sub_pkt = { .identifier = UART_IDENTIFIER_USB, .seq = pkt->seq };
+
+    while (batch_offset + 2 <= pkt->length) {
+        sub_pkt.descriptor = pkt->data[batch_offset];
+        sub_pkt.length = pkt->data[batch_offset + 1];
+        sub_pkt.data = &pkt->data[batch_offset + 2];
+        sub_pkt.processed = 0;
+        batch_offset += 2 + sub_pkt.length;
+
+        begin_batch_cmd();
+        if (batch_offset > pkt->length ||
+            sub_pkt.descriptor == USB_CMD_BATCH ||
+            sub_pkt.descriptor == USB_CMD_SET_HOST_LINK) {
+            send_return_code(RETURN_CODE_INVALID_ARGS);
+            break;
+        }
+        if (sub_pkt.descriptor == USB_CMD_ENTER_ACTIVE_DEBUG ||
+            sub_pkt.descriptor == USB_CMD_EXIT_ACTIVE_DEBUG ||
+            sub_pkt.descriptor == USB_CMD_INTERRUPT ||
+            sub_pkt.descriptor == USB_CMD_CHARGE_CMP ||
+            sub_pkt.descriptor == USB_CMD_DISCHARGE_CMP) {
+            send_return_code(RETURN_CODE_UNSUPPORTED);
+            continue;
+        }
+
+        executeUSBCmd(&sub_pkt);
+
+#ifdef CONFIG_TARGET_UART
+        if (target_xact_pending())
+            return; // resumed once the (last) response is in
+#endif
+    }
+
+    end_batch();
+    batch_pkt = NULL;
+    pkt->processed = 1;
+}
 #endif // CONFIG_HOST_UART
 
 void edb_server_init()
@@ -1048,6 +1601,10 @@ void edb_server_init()
     systick_start();
 #endif
 
+#ifdef CONFIG_TARGET_UART
+    target_xact_init();
+#endif
+
 #ifdef CONFIG_AUTO_ENABLED_WATCHPOINTS
     for (unsigned i = 0; i < CONFIG_AUTO_ENABLED_WATCHPOINTS; ++i)
         toggle_watchpoint(i, /* enable */ true, /* vcap snapshot */ true);
@@ -1083,29 +1640,55 @@ void edb_service(void)
     if (main_loop_flags & FLAG_EXITED_DEBUG_MODE) {
         main_loop_flags &= ~FLAG_EXITED_DEBUG_MODE;
 
+        host_msg_seq = debug_mode_cmd_seq;
         send_voltage(interrupt_context.restored_vcap);
+        host_msg_seq = 0;
+        debug_mode_cmd_seq = 0;
     }
 #endif
 
 #ifdef CONFIG_FETCH_INTERRUPT_CONTEXT 
+#ifdef CONFIG_TARGET_UART
+    // the context request waits for the pending request to target, if any
+    if (!target_xact_pending())
+#endif
     if (main_loop_flags & FLAG_INTERRUPTED) {
         main_loop_flags &= ~FLAG_INTERRUPTED;
 
         LOG("target interrupted\r\n");
+#ifdef CONFIG_HOST_UART
+        // do it here: reply marks completion of enter sequence
+        host_msg_seq = debug_mode_cmd_seq; // zero if target-initiated
+        debug_mode_cmd_seq = 0;
+#endif // CONFIG_HOST_UART
 #ifdef CONFIG_ENABLE_TARGET_SIDE_DEBUG_MODE
-        LOG("requesting int context\r\n");
         if (interrupt_context.type == INTERRUPT_TYPE_TARGET_REQ &&
-            debug_mode_flags & DEBUG_MODE_WITH_UART)
-            get_target_interrupt_context(&interrupt_context);
+            debug_mode_flags & DEBUG_MODE_WITH_UART) {
+            LOG("requesting int context\r\n");
+            // host is notified once the target replies
+            ASSERT(ASSERT_TARGET_XACT_BUSY, !target_xact_pending());
+            target_xact_begin(WISP_RSP_INTERRUPT_CONTEXT, CONFIG_TARGET_XACT_TIMEOUT,
+                              on_interrupted_target_context, 0);
+            target_comm_send_get_interrupt_context();
+        } else
 #endif // CONFIG_ENABLE_TARGET_SIDE_DEBUG_MODE
+        {
+            on_interrupted_target_context(NULL, 0);
+        }
 #ifdef CONFIG_HOST_UART
-        LOG("sending int context to host\r\n");
-        // do it here: reply marks completion of enter sequence
-        send_interrupt_context(&interrupt_context);
+        host_msg_seq = 0;
 #endif // CONFIG_HOST_UART
     }
 #endif // CONFIG_FETCH_INTERRUPT_CONTEXT 
 
+#ifdef CONFIG_DEBUG_MODE_SNAPSHOT
+    // Wait for the interrupt context from the target, if requested above
+    if ((main_loop_flags & FLAG_SNAPSHOT) && !target_xact_pending()) {
+        main_loop_flags &= ~FLAG_SNAPSHOT;
+        snapshot_start(); // host commands are held off until done
+    }
+#endif // CONFIG_DEBUG_MODE_SNAPSHOT
+
 #ifdef CONFIG_ENABLE_WATCHPOINT_STREAM
     if (main_loop_flags & FLAG_WATCHPOINT_READY) {
         send_watchpoint_events();
@@ -1116,32 +1699,61 @@ void edb_service(void)
 #ifdef CONFIG_ENABLE_VOLTAGE_STREAM
     if((main_loop_flags & FLAG_ADC_COMPLETE) && (main_loop_flags & FLAG_LOGGING)) {
         // ADC12 has completed conversion on all active channels
+        main_loop_flags &= ~FLAG_ADC_COMPLETE; // re-raised if more buffers are ready
         ADC_send_samples_to_host();
-        main_loop_flags &= ~FLAG_ADC_COMPLETE;
     }
 #endif // CONFIG_ENABLE_VOLTAGE_STREAM
 
+#ifdef CONFIG_HOST_UART_BAUDRATE_NEGOTIATION
+    if (main_loop_flags & FLAG_HOST_BAUDRATE_FALLBACK) {
+        main_loop_flags &= ~FLAG_HOST_BAUDRATE_FALLBACK;
+        if (host_baudrate_probe_pending) {
+            UART_revert_host_baudrate();
+            host_baudrate_probe_pending = false;
+        }
+    }
+#endif // CONFIG_HOST_UART_BAUDRATE_NEGOTIATION
+
 #ifdef CONFIG_HOST_UART
     if (main_loop_flags & FLAG_CHARGER_COMPLETE) { // comparator triggered after charge/discharge op
         main_loop_flags &= ~FLAG_CHARGER_COMPLETE;
+        host_msg_seq = charger_cmd_seq;
         send_return_code(RETURN_CODE_SUCCESS);
+        host_msg_seq = 0;
     }
 #endif
 
 #ifdef CONFIG_HOST_UART
-    if(main_loop_flags & FLAG_UART_USB_RX) {
-        // we've received a byte from USB
-        if(UART_buildRxPkt(UART_INTERFACE_USB, &usbRxPkt) == 0) {
-            // packet is complete
-            executeUSBCmd(&usbRxPkt);
+    // Bytes from USB are received by DMA, so there is no flag to check:
+    // poll the ring instead. The host may pipeline commands: execute them
+    // in order, replying with the sequence ID of each. While a request to
+    // the target is pending, the rest of a batch that made the request
+    // waits, and so does the next command if it needs the target (see
+    // host_cmd_needs_target), along with the commands after it. Others run
+    // meanwhile, so their replies may come before that of the request.
+    if (batch_pkt) {
+#ifdef CONFIG_TARGET_UART
+        if (!target_xact_pending())
+#endif
+        {
+            host_msg_seq = batch_pkt->seq;
+            run_batch();
+            host_msg_seq = 0;
         }
-
-        // check if we're done for now
-        UART_DISABLE_USB_RX; // disable interrupt so new bytes don't come in
-        if(UART_RxBufEmpty(UART_INTERFACE_USB)) {
-            main_loop_flags &= ~FLAG_UART_USB_RX; // clear USB Rx flag
+    } else {
+        uartPkt_t *usbRxPkt = UART_peek_host_cmd();
+#ifdef CONFIG_TARGET_UART
+        if (usbRxPkt && target_xact_pending() &&
+            host_cmd_needs_target(usbRxPkt->descriptor))
+            usbRxPkt = NULL; // held until the request completes
+#endif
+        if (usbRxPkt)
+            usbRxPkt = UART_next_host_cmd(); // the same, unless lost to an overrun
+        if (usbRxPkt) {
+            host_msg_seq = usbRxPkt->seq;
+            executeUSBCmd(usbRxPkt);
+            host_msg_seq = 0;
         }
-        UART_ENABLE_USB_RX; // enable interrupt
     }
 #endif // CONFIG_HOST_UART
 
@@ -1152,29 +1764,39 @@ void edb_service(void)
     }
 */
 
-#if defined(CONFIG_TARGET_UART) && defined(CONFIG_TARGET_UART_PUSH)
+#ifdef CONFIG_TARGET_UART
+    if (main_loop_flags & FLAG_TARGET_XACT_TIMEOUT)
+        target_xact_expire();
+
     if(main_loop_flags & FLAG_UART_WISP_RX) {
         // we've received a byte over UART from the WISP
         if(UART_buildRxPkt(UART_INTERFACE_WISP, &wispRxPkt) == 0) {
-            switch (wispRxPkt.descriptor) {
-                case WISP_RSP_INTERRUPTED:
-                    UART_teardown(UART_INTERFACE_WISP); // for symmetry; setup in ISR
-                    complete_signal_target_by_level();
-
-                    // wait for target to go to sleep and start listening
-                    __delay_cycles(INTERRUPT_ON_BOOT_LATENCY);
-                    enter_debug_mode(INTERRUPT_TYPE_DEBUGGER_REQ, DEBUG_MODE_FULL_FEATURES);
-                    break;
-                case WISP_RSP_STDIO:
-#ifdef CONFIG_HOST_UART
-                    forward_msg_to_host(USB_RSP_STDIO, wispRxPkt.data, wispRxPkt.length);
+            // responses to requests go to the pending transaction
+            if (!target_xact_complete(&wispRxPkt)) {
+#ifdef CONFIG_TARGET_UART_PUSH
+                switch (wispRxPkt.descriptor) {
+                    case WISP_RSP_INTERRUPTED:
+                        UART_teardown(UART_INTERFACE_WISP); // for symmetry; setup in ISR
+                        complete_signal_target_by_level();
+
+                        // wait for target to go to sleep and start listening
+                        __delay_cycles(INTERRUPT_ON_BOOT_LATENCY);
+                        enter_debug_mode(INTERRUPT_TYPE_DEBUGGER_REQ, DEBUG_MODE_FULL_FEATURES);
+                        break;
+                    case WISP_RSP_STDIO:
+#if defined(CONFIG_TARGET_STDIO_COALESCE)
+                        target_stdio_append(&wispRxPkt);
+#elif defined(CONFIG_HOST_UART)
+                        UART_forward_target_pkt(USB_RSP_STDIO, &wispRxPkt);
 #endif
-                    break;
+                        break;
 #ifdef CONFIG_COLLECT_APP_OUTPUT
-                case WISP_RSP_APP_OUTPUT:
-                    payload_record_app_output(wispRxPkt.data, wispRxPkt.length);
-                    break;
+                    case WISP_RSP_APP_OUTPUT:
+                        payload_record_app_output(wispRxPkt.data, wispRxPkt.length);
+                        break;
 #endif
+                }
+#endif // CONFIG_TARGET_UART_PUSH
             }
             wispRxPkt.processed = 1;
         }
@@ -1183,7 +1805,15 @@ void edb_service(void)
             main_loop_flags &= ~FLAG_UART_WISP_RX; // clear WISP Rx flag
         }
     }
-#endif // defined(CONFIG_TARGET_UART) && defined(CONFIG_TARGET_UART_PUSH)
+
+#ifdef CONFIG_TARGET_STDIO_COALESCE
+    target_stdio_service();
+#endif
+#endif // CONFIG_TARGET_UART
+
+#ifdef CONFIG_PERIODIC_PAYLOAD
+    payload_service();
+#endif
 
 /*
     if(main_loop_flags & FLAG_UART_WISP_TX) {
@@ -1385,7 +2015,7 @@ void __attribute__ ((interrupt(UNMI_VECTOR))) unmi_isr(void)
     while (1);
 }
 
-#ifdef DMA_HOST_UART_TX
+#if defined(DMA_HOST_UART_TX) || defined(DMA_TARGET_UART_TX) || defined(DMA_ADC)
 #if defined(__TI_COMPILER_VERSION__) || defined(__IAR_SYSTEMS_ICC__)
 #pragma vector=DMA_VECTOR
 __interrupt void DMA_ISR(void)
@@ -1398,7 +2028,22 @@ void __attribute__ ((interrupt(DMA_VECTOR))) DMA_ISR (void)
     switch (__even_in_range(DMAIV, 16)) {
 #ifdef DMA_HOST_UART_TX
         case DMA_INTFLAG(DMA_HOST_UART_TX):
-               host_uart_status &= ~UART_STATUS_TX_BUSY;
+            UART_host_tx_complete();
+            break;
+#endif
+#ifdef DMA_HOST_UART_RX
+        case DMA_INTFLAG(DMA_HOST_UART_RX):
+            UART_host_rx_wrapped();
+            break;
+#endif
+#ifdef DMA_TARGET_UART_TX
+        case DMA_INTFLAG(DMA_TARGET_UART_TX):
+            UART_target_tx_complete();
+            break;
+#endif
+#ifdef DMA_ADC
+        case DMA_INTFLAG(DMA_ADC):
+            ADC_dma_complete();
             break;
 #endif
     }
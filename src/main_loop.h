@@ -12,13 +12,16 @@ typedef enum {
     FLAG_UART_USB_RX            = 0x0002, //!< Bytes received on the USB UART
     FLAG_UART_USB_TX            = 0x0004, //!< Bytes transmitted on the USB UART
     FLAG_UART_WISP_RX           = 0x0008, //!< Bytes received on the WISP UART
-    FLAG_UART_WISP_TX           = 0x0010, //!< Bytes transmitted on the WISP UART
+    FLAG_UART_WISP_TX           = 0x0010, //!< Message transmitted on the WISP UART
     FLAG_LOGGING                = 0x0020, //!< Logging ADC conversion results to USB
     FLAG_RF_DATA				= 0x0040, //!< RF Rx activity ready to be logged
     FLAG_CHARGER_COMPLETE		= 0x0080, //!< Charge or discharge operation completed
     FLAG_INTERRUPTED     		= 0x0100, //!< target is in active debug mode
     FLAG_EXITED_DEBUG_MODE      = 0x0200, //!< debugger has restored energy level
     FLAG_WATCHPOINT_READY       = 0x0400, //!< watchpoint event ready for transmission to host
+    FLAG_HOST_BAUDRATE_FALLBACK = 0x0800, //!< no probe at new host link rate: revert to old rate
+    FLAG_TARGET_XACT_TIMEOUT    = 0x1000, //!< no response from target to pending request
+    FLAG_SNAPSHOT               = 0x2000, //!< capture snapshot regions of target memory
 } main_loop_flag_t;
 
 extern volatile uint16_t main_loop_flags; // bit mask containing bit flags to check in the main loop
@@ -0,0 +1,167 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <msp430.h>
+
+#include <libedb/target_comm.h>
+
+#include "config.h"
+#include "uart.h"
+#include "host_comm.h"
+#include "host_comm_impl.h"
+#include "target_comm_impl.h"
+#include "target_xact.h"
+
+#include "mem_cache.h"
+
+#if CONFIG_MEM_CACHE_LINE_LEN & (CONFIG_MEM_CACHE_LINE_LEN - 1)
+#error Memory cache line length is not a power of two: CONFIG_MEM_CACHE_LINE_LEN
+#endif
+
+#if CONFIG_MEM_CACHE_FILL_LEN > UART_PKT_MAX_DATA_LEN
+#error Memory cache fill does not fit in a packet from target: CONFIG_MEM_CACHE_FILL_LEN
+#endif
+
+#define LINE_MASK ((uint32_t)CONFIG_MEM_CACHE_LINE_LEN - 1)
+
+typedef struct {
+    uint32_t address; // of the first byte
+    bool valid;
+    uint8_t data[CONFIG_MEM_CACHE_LINE_LEN];
+} mem_cache_line_t;
+
+static mem_cache_line_t lines[CONFIG_MEM_CACHE_LINES];
+static unsigned next_victim; // round-robin replacement
+
+mem_cache_stats_t mem_cache_stats;
+
+// The host request being served by the pending fill
+static uint32_t read_address;
+static unsigned read_len;
+static uint32_t fill_address;
+static unsigned fill_len;
+
+static mem_cache_line_t *find_line(uint32_t address)
+{
+    unsigned i;
+
+    for (i = 0; i < CONFIG_MEM_CACHE_LINES; ++i) {
+        if (lines[i].valid && lines[i].address == address)
+            return &lines[i];
+    }
+    return NULL;
+}
+
+// Copy a range out of the cache, if all of it is there
+static bool lookup(uint32_t address, uint8_t *buf, unsigned len)
+{
+    mem_cache_line_t *line;
+    unsigned offset, n;
+
+    while (len > 0) {
+        line = find_line(address & ~LINE_MASK);
+        if (!line)
+            return false;
+
+        offset = address & LINE_MASK;
+        n = CONFIG_MEM_CACHE_LINE_LEN - offset;
+        if (n > len)
+            n = len;
+
+        memcpy(buf, &line->data[offset], n);
+        buf += n;
+        address += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Store the lines of a line-aligned range
+static void fill(uint32_t address, const uint8_t *data, unsigned len)
+{
+    mem_cache_line_t *line;
+
+    while (len >= CONFIG_MEM_CACHE_LINE_LEN) {
+        line = find_line(address);
+        if (!line) {
+            line = &lines[next_victim];
+            next_victim = (next_victim + 1) % CONFIG_MEM_CACHE_LINES;
+        }
+
+        line->address = address;
+        memcpy(line->data, data, CONFIG_MEM_CACHE_LINE_LEN);
+        line->valid = true;
+
+        address += CONFIG_MEM_CACHE_LINE_LEN;
+        data += CONFIG_MEM_CACHE_LINE_LEN;
+        len -= CONFIG_MEM_CACHE_LINE_LEN;
+    }
+}
+
+static void on_uncached_rsp(uartPkt_t *rsp, unsigned arg)
+{
+    if (rsp)
+        UART_forward_target_pkt(USB_RSP_WISP_MEMORY, rsp);
+    else
+        send_return_code(RETURN_CODE_COMM_ERROR);
+}
+
+static void on_fill_rsp(uartPkt_t *rsp, unsigned arg)
+{
+    if (!rsp || rsp->length != fill_len) {
+        send_return_code(RETURN_CODE_COMM_ERROR);
+        return;
+    }
+
+    fill(fill_address, rsp->data, rsp->length);
+    forward_msg_to_host(USB_RSP_WISP_MEMORY,
+                        &rsp->data[read_address - fill_address], read_len);
+}
+
+return_code_t mem_cache_read(uint32_t address, unsigned len)
+{
+    uint8_t buf[CONFIG_MEM_CACHE_FILL_LEN];
+    uint32_t end = address + len;
+
+    if (len == 0) // would count as a hit without reading anything
+        return RETURN_CODE_INVALID_ARGS;
+
+    if (address >= CONFIG_MEM_CACHE_MIN_ADDRESS && len <= sizeof(buf) &&
+        lookup(address, buf, len)) {
+        mem_cache_stats.hits++;
+        forward_msg_to_host(USB_RSP_WISP_MEMORY, buf, len);
+        return RETURN_CODE_SUCCESS;
+    }
+
+    if (target_xact_pending())
+        return RETURN_CODE_BUSY;
+
+    mem_cache_stats.misses++;
+
+    fill_address = address & ~LINE_MASK;
+    fill_len = ((end + LINE_MASK) & ~LINE_MASK) - fill_address;
+
+    if (address < CONFIG_MEM_CACHE_MIN_ADDRESS ||
+        fill_len > CONFIG_MEM_CACHE_FILL_LEN) {
+        target_xact_begin(WISP_RSP_MEMORY, CONFIG_TARGET_XACT_TIMEOUT,
+                          on_uncached_rsp, 0);
+        target_comm_send_read_mem(address, len);
+        return RETURN_CODE_SUCCESS;
+    }
+
+    read_address = address;
+    read_len = len;
+
+    target_xact_begin(WISP_RSP_MEMORY, CONFIG_TARGET_XACT_TIMEOUT, on_fill_rsp, 0);
+    target_comm_send_read_mem(fill_address, fill_len);
+    return RETURN_CODE_SUCCESS;
+}
+
+void mem_cache_invalidate()
+{
+    unsigned i;
+
+    for (i = 0; i < CONFIG_MEM_CACHE_LINES; ++i)
+        lines[i].valid = false;
+}
@@ -0,0 +1,38 @@
+#ifndef MEM_CACHE_H
+#define MEM_CACHE_H
+
+#include <stdint.h>
+
+#include "host_comm.h"
+
+/**
+ * @brief   Counters of reads of target memory by the host
+ */
+typedef struct {
+    uint16_t hits;      //!< reads served from the cache
+    uint16_t misses;    //!< reads that went to the target
+} mem_cache_stats_t;
+
+extern mem_cache_stats_t mem_cache_stats;
+
+/**
+ * @brief   Reply to a host request to read target memory
+ * @details Served from the cache if all bytes are in it. Otherwise, the
+ *          aligned lines that cover the range are read from the target (by a
+ *          transaction that runs from the main loop) and kept in the cache.
+ *          Ranges below CONFIG_MEM_CACHE_MIN_ADDRESS (peripheral registers)
+ *          are read from the target exactly as requested and never cached.
+ * @return  RETURN_CODE_INVALID_ARGS for an empty range, RETURN_CODE_BUSY if
+ *          the read needs the target while a request to it is pending
+ *          (nothing is sent to host in either case)
+ */
+return_code_t mem_cache_read(uint32_t address, unsigned len);
+
+/**
+ * @brief   Drop all cached lines
+ * @details Called whenever the target memory may change: on writes, and
+ *          when the target enters or leaves debug mode.
+ */
+void mem_cache_invalidate();
+
+#endif // MEM_CACHE_H
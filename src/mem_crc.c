@@ -0,0 +1,150 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <msp430.h>
+
+#include <libedb/target_comm.h>
+#include <libmsp/periph.h>
+
+#include "config.h"
+#include "pin_assign.h"
+#include "error.h"
+#include "minmax.h"
+#include "crc.h"
+#include "uart.h"
+#include "host_comm.h"
+#include "host_comm_impl.h"
+#include "target_comm_impl.h"
+#include "target_xact.h"
+
+#include "mem_crc.h"
+
+#define CRC_ADDRESS_LEN sizeof(uint32_t)
+#define CRC_LEN sizeof(uint16_t)
+
+// Buffer layout: [ address of first block (uint32) | CRC (uint16) per block ]
+static uint8_t crc_frame_buf[CRC_ADDRESS_LEN + CONFIG_CRC_MEM_FRAME_BLOCKS * CRC_LEN];
+static volatile bool crc_frame_busy; // on the wire to host
+static unsigned crc_frame_len; // bytes of CRCs in the buffer
+static unsigned crc_frame_cap; // max bytes of CRCs for the current host link
+
+static uint32_t crc_address; // next address to request from target
+static uint32_t crc_remaining; // bytes not yet requested
+static uint32_t crc_block_len;
+static uint32_t crc_req_block_left; // bytes of the requested block not yet requested
+
+static unsigned crc_chunk_len; // bytes in the pending request
+static bool crc_chunk_ends_block; // pending request is the last of its block
+
+static uint32_t crc_block_address; // of the block being summed
+static uint32_t crc_block_sum_len; // bytes summed into the block
+static uint16_t crc_block; // CRC of the block so far
+
+static void on_crc_chunk(uartPkt_t *rsp, unsigned arg);
+
+static void on_crc_frame_sent(uint8_t *buf)
+{
+    crc_frame_busy = false;
+}
+
+static void begin_frame(uint32_t address)
+{
+    while (crc_frame_busy); // the host link is faster than the target link
+
+    crc_frame_buf[0] = (address >> 0) & 0xff;
+    crc_frame_buf[1] = (address >> 8) & 0xff;
+    crc_frame_buf[2] = (address >> 16) & 0xff;
+    crc_frame_buf[3] = (address >> 24) & 0xff;
+    crc_frame_len = 0;
+}
+
+static void send_frame()
+{
+    crc_frame_busy = true;
+    UART_send_msg_to_host(USB_RSP_MEMORY_CRC, CRC_ADDRESS_LEN + crc_frame_len,
+                          crc_frame_buf, on_crc_frame_sent);
+}
+
+static void request_chunk()
+{
+    // (MIN would truncate the lengths to 16 bits)
+    if (crc_req_block_left == 0)
+        crc_req_block_left = crc_remaining < crc_block_len ? crc_remaining : crc_block_len;
+
+    crc_chunk_len = crc_req_block_left < CONFIG_DUMP_MEM_CHUNK_LEN ?
+                    crc_req_block_left : CONFIG_DUMP_MEM_CHUNK_LEN;
+
+    ASSERT(ASSERT_TARGET_XACT_BUSY, !target_xact_pending());
+    target_xact_begin(WISP_RSP_MEMORY, CONFIG_TARGET_XACT_TIMEOUT, on_crc_chunk, 0);
+    target_comm_send_read_mem(crc_address, crc_chunk_len);
+
+    crc_address += crc_chunk_len;
+    crc_remaining -= crc_chunk_len;
+    crc_req_block_left -= crc_chunk_len;
+    crc_chunk_ends_block = crc_req_block_left == 0;
+}
+
+static void on_crc_chunk(uartPkt_t *rsp, unsigned arg)
+{
+    bool ends_block = crc_chunk_ends_block;
+    bool last = crc_remaining == 0;
+
+    if (!rsp || rsp->length != crc_chunk_len) {
+        if (crc_frame_len > 0)
+            send_frame(); // deliver the CRCs of complete blocks
+        send_return_code(RETURN_CODE_COMM_ERROR);
+        return;
+    }
+
+    // Target reads the next chunk while this one is summed
+    if (!last)
+        request_chunk();
+
+    crc_block = crc16_update(crc_block, rsp->data, rsp->length);
+    crc_block_sum_len += rsp->length;
+
+    if (!ends_block)
+        return;
+
+    crc_frame_buf[CRC_ADDRESS_LEN + crc_frame_len++] = crc_block & 0xff;
+    crc_frame_buf[CRC_ADDRESS_LEN + crc_frame_len++] = crc_block >> 8;
+
+    crc_block_address += crc_block_sum_len;
+    crc_block_sum_len = 0;
+    crc_block = CRC16_INIT;
+
+    if (last) {
+        send_frame();
+        send_return_code(RETURN_CODE_SUCCESS);
+        return;
+    }
+
+    if (crc_frame_len + CRC_LEN > crc_frame_cap) {
+        send_frame();
+        begin_frame(crc_block_address);
+    }
+}
+
+return_code_t mem_crc_start(uint32_t address, uint32_t len, uint32_t block_len)
+{
+    if (len == 0)
+        return RETURN_CODE_INVALID_ARGS;
+    if (target_xact_pending())
+        return RETURN_CODE_BUSY;
+
+    crc_frame_cap = MIN(CONFIG_CRC_MEM_FRAME_BLOCKS * CRC_LEN,
+                        UART_host_max_payload_len() - CRC_ADDRESS_LEN);
+
+    crc_address = address;
+    crc_remaining = len;
+    crc_block_len = (block_len == 0 || block_len > len) ? len : block_len;
+    crc_req_block_left = 0;
+
+    crc_block_address = address;
+    crc_block_sum_len = 0;
+    crc_block = CRC16_INIT;
+
+    begin_frame(address);
+    request_chunk();
+    return RETURN_CODE_SUCCESS;
+}
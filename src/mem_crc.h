@@ -0,0 +1,22 @@
+#ifndef MEM_CRC_H
+#define MEM_CRC_H
+
+#include <stdint.h>
+
+#include "host_comm.h"
+
+/**
+ * @brief   Start computing CRCs of blocks of a range of target memory
+ * @param   block_len   Bytes per block, zero for one block over the range
+ * @return  RETURN_CODE_SUCCESS if started: the CRCs are then sent as
+ *          USB_RSP_MEMORY_CRC messages, followed by a return code once
+ *          the range is done or reading it fails.
+ * @details The target has no command to compute a CRC, so EDB reads the
+ *          range in chunks, by transactions that run from the main loop,
+ *          and computes CRC-16 (see crc.h) of each block as chunks arrive.
+ *          The next chunk is requested before the previous one is added to
+ *          the CRC. The last block may be shorter than block_len.
+ */
+return_code_t mem_crc_start(uint32_t address, uint32_t len, uint32_t block_len);
+
+#endif // MEM_CRC_H
@@ -0,0 +1,133 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <msp430.h>
+
+#include <libedb/target_comm.h>
+#include <libmsp/periph.h>
+
+#include "config.h"
+#include "pin_assign.h"
+#include "error.h"
+#include "minmax.h"
+#include "uart.h"
+#include "host_comm.h"
+#include "host_comm_impl.h"
+#include "target_comm_impl.h"
+#include "target_xact.h"
+
+#include "mem_dump.h"
+
+#if CONFIG_DUMP_MEM_CHUNK_LEN > UART_PKT_MAX_DATA_LEN
+#error Memory dump chunk does not fit in a packet from target: CONFIG_DUMP_MEM_CHUNK_LEN
+#endif
+
+#if CONFIG_DUMP_MEM_FRAME_DATA_LEN < CONFIG_DUMP_MEM_CHUNK_LEN
+#error Memory dump frame is smaller than a chunk: CONFIG_DUMP_MEM_FRAME_DATA_LEN
+#endif
+
+#define DUMP_ADDRESS_LEN sizeof(uint32_t)
+#define DUMP_FRAME_BUF_SIZE (DUMP_ADDRESS_LEN + CONFIG_DUMP_MEM_FRAME_DATA_LEN)
+
+// Buffer layout: [ address of first byte (uint32) | bytes ]
+static uint8_t dump_bufs[2][DUMP_FRAME_BUF_SIZE]; // double-buffer pair
+static volatile bool dump_buf_busy[2]; // on the wire to host
+static unsigned dump_buf_idx; // buffer being filled
+static unsigned dump_frame_len; // bytes in the buffer being filled
+static unsigned dump_frame_cap; // max bytes in a frame for the current host link
+
+static uint32_t dump_address; // next address to request from target
+static uint32_t dump_remaining; // bytes not yet requested
+static unsigned dump_chunk_max; // max bytes per request
+static unsigned dump_chunk_len; // bytes in the pending request
+
+static void on_dump_chunk(uartPkt_t *rsp, unsigned arg);
+
+static void on_dump_frame_sent(uint8_t *buf)
+{
+    unsigned buf_idx = (buf == &dump_bufs[0][0]) ? 0 : 1;
+    dump_buf_busy[buf_idx] = false;
+}
+
+static void begin_frame(uint32_t address)
+{
+    uint8_t *buf = &dump_bufs[dump_buf_idx][0];
+
+    // the host link is faster than the target link, so this is short
+    while (dump_buf_busy[dump_buf_idx]);
+
+    buf[0] = (address >> 0) & 0xff;
+    buf[1] = (address >> 8) & 0xff;
+    buf[2] = (address >> 16) & 0xff;
+    buf[3] = (address >> 24) & 0xff;
+    dump_frame_len = 0;
+}
+
+static void send_frame()
+{
+    dump_buf_busy[dump_buf_idx] = true;
+    UART_send_msg_to_host(USB_RSP_MEMORY_DUMP, DUMP_ADDRESS_LEN + dump_frame_len,
+                          &dump_bufs[dump_buf_idx][0], on_dump_frame_sent);
+    dump_buf_idx ^= 1;
+}
+
+static void request_chunk()
+{
+    // (MIN would truncate the remaining length to 16 bits)
+    dump_chunk_len = dump_remaining < dump_chunk_max ? dump_remaining : dump_chunk_max;
+
+    ASSERT(ASSERT_TARGET_XACT_BUSY, !target_xact_pending());
+    target_xact_begin(WISP_RSP_MEMORY, CONFIG_TARGET_XACT_TIMEOUT, on_dump_chunk, 0);
+    target_comm_send_read_mem(dump_address, dump_chunk_len);
+
+    dump_address += dump_chunk_len;
+    dump_remaining -= dump_chunk_len;
+}
+
+static void on_dump_chunk(uartPkt_t *rsp, unsigned arg)
+{
+    if (!rsp || rsp->length != dump_chunk_len) {
+        if (dump_frame_len > 0)
+            send_frame(); // deliver the bytes read so far
+        send_return_code(RETURN_CODE_COMM_ERROR);
+        return;
+    }
+
+    memcpy(&dump_bufs[dump_buf_idx][DUMP_ADDRESS_LEN + dump_frame_len],
+           rsp->data, rsp->length);
+    dump_frame_len += rsp->length;
+
+    if (dump_remaining == 0) { // this was the last chunk
+        send_frame();
+        send_return_code(RETURN_CODE_SUCCESS);
+        return;
+    }
+
+    // Target reads the next chunk while this frame goes to host
+    request_chunk();
+
+    if (dump_frame_len + dump_chunk_len > dump_frame_cap) {
+        send_frame();
+        begin_frame(dump_address - dump_chunk_len);
+    }
+}
+
+return_code_t mem_dump_start(uint32_t address, uint32_t len)
+{
+    if (len == 0 || len > CONFIG_DUMP_MEM_MAX_LEN)
+        return RETURN_CODE_INVALID_ARGS;
+    if (target_xact_pending())
+        return RETURN_CODE_BUSY;
+
+    dump_frame_cap = MIN(CONFIG_DUMP_MEM_FRAME_DATA_LEN,
+                         UART_host_max_payload_len() - DUMP_ADDRESS_LEN);
+    dump_chunk_max = MIN(CONFIG_DUMP_MEM_CHUNK_LEN, dump_frame_cap);
+
+    dump_address = address;
+    dump_remaining = len;
+
+    begin_frame(address);
+    request_chunk();
+    return RETURN_CODE_SUCCESS;
+}
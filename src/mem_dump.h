@@ -0,0 +1,22 @@
+#ifndef MEM_DUMP_H
+#define MEM_DUMP_H
+
+#include <stdint.h>
+
+#include "host_comm.h"
+
+/**
+ * @brief   Start streaming a range of target memory to the host
+ * @return  RETURN_CODE_SUCCESS if started: the memory is then sent as
+ *          USB_RSP_MEMORY_DUMP messages, followed by a return code once
+ *          the dump completes or fails. RETURN_CODE_INVALID_ARGS if the
+ *          length is zero or over CONFIG_DUMP_MEM_MAX_LEN.
+ * @details The range is read from the target in chunks, by transactions
+ *          that run from the main loop. The next chunk is requested before
+ *          the previous data is sent to host, so the target and host links
+ *          are busy at the same time. Chunks are gathered into messages of
+ *          up to CONFIG_DUMP_MEM_FRAME_DATA_LEN bytes.
+ */
+return_code_t mem_dump_start(uint32_t address, uint32_t len);
+
+#endif // MEM_DUMP_H
@@ -0,0 +1,146 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <msp430.h>
+
+#include <libedb/target_comm.h>
+#include <libmsp/periph.h>
+
+#include "config.h"
+#include "pin_assign.h"
+#include "error.h"
+#include "minmax.h"
+#include "uart.h"
+#include "host_comm.h"
+#include "host_comm_impl.h"
+#include "target_comm_impl.h"
+#include "target_xact.h"
+
+#include "mem_gather.h"
+
+#define GATHER_RANGE_LEN (sizeof(uint32_t) + sizeof(uint8_t)) // in the list
+
+typedef struct {
+    uint32_t address;
+    unsigned len;
+    unsigned offset; // of its bytes in the reply
+    bool done;
+} gather_range_t;
+
+static gather_range_t gather_ranges[CONFIG_GATHER_MAX_RANGES];
+static unsigned gather_count;
+
+static uint8_t gather_buf[CONFIG_GATHER_MAX_LEN]; // reply to host
+static volatile bool gather_buf_busy; // on the wire to host
+static unsigned gather_len; // bytes in the reply
+
+static uint32_t span_address; // of the pending request
+static unsigned span_len;
+
+static void on_gather_span(uartPkt_t *rsp, unsigned arg);
+
+static void on_gather_reply_sent(uint8_t *buf)
+{
+    gather_buf_busy = false;
+}
+
+// Request the span from the lowest range left, covering all ranges that fit
+// in one packet from the target
+static bool request_span()
+{
+    gather_range_t *range;
+    uint32_t end, range_end;
+    unsigned i;
+    bool found = false;
+
+    for (i = 0; i < gather_count; ++i) {
+        range = &gather_ranges[i];
+        if (!range->done && (!found || range->address < span_address)) {
+            span_address = range->address;
+            found = true;
+        }
+    }
+    if (!found)
+        return false;
+
+    end = span_address;
+    for (i = 0; i < gather_count; ++i) {
+        range = &gather_ranges[i];
+        range_end = range->address + range->len;
+        if (!range->done && range->address >= span_address &&
+            range_end - span_address <= UART_PKT_MAX_DATA_LEN && range_end > end)
+            end = range_end;
+    }
+    span_len = end - span_address;
+
+    ASSERT(ASSERT_TARGET_XACT_BUSY, !target_xact_pending());
+    target_xact_begin(WISP_RSP_MEMORY, CONFIG_TARGET_XACT_TIMEOUT, on_gather_span, 0);
+    target_comm_send_read_mem(span_address, span_len);
+    return true;
+}
+
+static void on_gather_span(uartPkt_t *rsp, unsigned arg)
+{
+    gather_range_t *range;
+    unsigned i;
+
+    if (!rsp || rsp->length != span_len) {
+        send_return_code(RETURN_CODE_COMM_ERROR);
+        return;
+    }
+
+    for (i = 0; i < gather_count; ++i) {
+        range = &gather_ranges[i];
+        if (!range->done && range->address >= span_address &&
+            range->address + range->len <= span_address + span_len) {
+            memcpy(&gather_buf[range->offset],
+                   &rsp->data[range->address - span_address], range->len);
+            range->done = true;
+        }
+    }
+
+    if (request_span())
+        return;
+
+    gather_buf_busy = true;
+    UART_send_msg_to_host(USB_RSP_WISP_MEMORY_GATHER, gather_len, gather_buf,
+                          on_gather_reply_sent);
+}
+
+return_code_t mem_gather_start(const uint8_t *list, unsigned count)
+{
+    gather_range_t *range;
+    unsigned i;
+
+    if (count == 0 || count > CONFIG_GATHER_MAX_RANGES)
+        return RETURN_CODE_INVALID_ARGS;
+    if (target_xact_pending())
+        return RETURN_CODE_BUSY;
+
+    while (gather_buf_busy); // previous reply is still going out
+
+    gather_len = 0;
+    for (i = 0; i < count; ++i) {
+        range = &gather_ranges[i];
+
+        range->address = ((uint32_t)list[3] << 24) | ((uint32_t)list[2] << 16) |
+                         ((uint32_t)list[1] << 8) | list[0];
+        range->len = list[4];
+        range->offset = gather_len;
+        range->done = false;
+        list += GATHER_RANGE_LEN;
+
+        if (range->len == 0 || range->len > UART_PKT_MAX_DATA_LEN)
+            return RETURN_CODE_INVALID_ARGS;
+
+        gather_len += range->len;
+    }
+
+    if (gather_len > MIN(sizeof(gather_buf), UART_host_max_payload_len()))
+        return RETURN_CODE_BUFFER_TOO_SMALL;
+
+    gather_count = count;
+    request_span();
+    return RETURN_CODE_SUCCESS;
+}
@@ -0,0 +1,22 @@
+#ifndef MEM_GATHER_H
+#define MEM_GATHER_H
+
+#include <stdint.h>
+
+#include "host_comm.h"
+
+/**
+ * @brief   Start reading a list of ranges of target memory
+ * @param   list    (address (uint32), length (uint8)) per range
+ * @param   count   Number of ranges, at most CONFIG_GATHER_MAX_RANGES
+ * @return  RETURN_CODE_SUCCESS if started: the bytes of all ranges are then
+ *          sent in one USB_RSP_WISP_MEMORY_GATHER message, in list order,
+ *          or a return code if reading fails.
+ * @details Ranges that lie close together are read with one request to the
+ *          target, over the span that covers them, up to the largest packet
+ *          the target can reply with. Requests are issued by transactions
+ *          that run from the main loop.
+ */
+return_code_t mem_gather_start(const uint8_t *list, unsigned count);
+
+#endif // MEM_GATHER_H
@@ -0,0 +1,194 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <msp430.h>
+
+#include <libedb/target_comm.h>
+#include <libmsp/periph.h>
+
+#include "config.h"
+#include "pin_assign.h"
+#include "error.h"
+#include "minmax.h"
+#include "crc.h"
+#include "uart.h"
+#include "host_comm.h"
+#include "host_comm_impl.h"
+#include "target_comm_impl.h"
+#include "target_xact.h"
+
+#ifdef CONFIG_TARGET_MEM_CACHE
+#include "mem_cache.h"
+#endif
+
+#include "mem_write.h"
+
+// Address (uint32) and length (uint8) precede the bytes in a write command
+#define WRITE_CHUNK_MAX_LEN (WISP_CMD_MAX_LEN - sizeof(uint32_t) - sizeof(uint8_t))
+
+#if CONFIG_MEM_WRITE_VERIFY_CHUNK_LEN > UART_PKT_MAX_DATA_LEN
+#error CONFIG_MEM_WRITE_VERIFY_CHUNK_LEN: read response does not fit in a message from target
+#endif
+
+#if CONFIG_MEM_WRITE_PIPELINE_DEPTH < 1
+#error CONFIG_MEM_WRITE_PIPELINE_DEPTH: at least one request must be in flight
+#endif
+
+typedef enum {
+    WRITE_PHASE_WRITE,
+    WRITE_PHASE_VERIFY,
+} write_phase_t;
+
+static uint8_t write_buf[CONFIG_MEM_WRITE_STAGING_LEN];
+static unsigned write_len; // of the transfer
+static unsigned staged_len; // bytes received from host so far
+static uint32_t write_address; // start of the range
+static uint16_t write_crc; // CRC of the bytes staged so far
+
+static write_phase_t write_phase;
+static unsigned chunk_max_len; // per request, in this phase
+static unsigned sent_offset; // of the next chunk to request
+static unsigned done_offset; // of the oldest chunk not yet answered
+static unsigned chunks_in_flight;
+static bool write_failed; // return code sent, responses in flight are ignored
+static uint16_t verify_crc; // CRC of the bytes read back so far
+
+static void on_chunk(uartPkt_t *rsp, unsigned arg);
+
+static inline unsigned chunk_len(unsigned offset)
+{
+    return MIN(write_len - offset, chunk_max_len);
+}
+
+// The first request starts the transaction, the others are pipelined in it
+static void request_chunk()
+{
+    unsigned len = chunk_len(sent_offset);
+
+    if (chunks_in_flight == 0) {
+        ASSERT(ASSERT_TARGET_XACT_BUSY, !target_xact_pending());
+        target_xact_begin(WISP_RSP_MEMORY, CONFIG_TARGET_XACT_TIMEOUT, on_chunk, 0);
+    } else {
+        target_xact_add_request();
+    }
+
+    if (write_phase == WRITE_PHASE_WRITE)
+        target_comm_send_write_mem(write_address + sent_offset,
+                                   &write_buf[sent_offset], len);
+    else
+        target_comm_send_read_mem(write_address + sent_offset, len);
+
+    sent_offset += len;
+    chunks_in_flight++;
+}
+
+static void fill_pipeline()
+{
+    while (chunks_in_flight < CONFIG_MEM_WRITE_PIPELINE_DEPTH &&
+           sent_offset < write_len)
+        request_chunk();
+}
+
+static void start_phase(write_phase_t phase)
+{
+    write_phase = phase;
+    chunk_max_len = phase == WRITE_PHASE_WRITE ?
+        WRITE_CHUNK_MAX_LEN : CONFIG_MEM_WRITE_VERIFY_CHUNK_LEN;
+    sent_offset = 0;
+    done_offset = 0;
+    fill_pipeline();
+}
+
+static void on_chunk(uartPkt_t *rsp, unsigned arg)
+{
+    unsigned len = chunk_len(done_offset);
+
+    if (write_failed) { // draining the responses to requests in flight
+        chunks_in_flight--;
+        return;
+    }
+
+    if (!rsp || (write_phase == WRITE_PHASE_VERIFY && rsp->length != len)) {
+        // on timeout, the transaction is over: no more callbacks
+        chunks_in_flight = rsp ? chunks_in_flight - 1 : 0;
+        write_failed = true;
+        send_return_code(RETURN_CODE_COMM_ERROR);
+        return;
+    }
+
+    chunks_in_flight--;
+    if (write_phase == WRITE_PHASE_VERIFY)
+        verify_crc = crc16_update(verify_crc, rsp->data, len);
+    done_offset += len;
+
+    if (done_offset < write_len) {
+        fill_pipeline();
+        return;
+    }
+
+    if (write_phase == WRITE_PHASE_WRITE) { // all written: read the range back
+        verify_crc = CRC16_INIT;
+        start_phase(WRITE_PHASE_VERIFY);
+        return;
+    }
+
+    send_return_code(verify_crc == write_crc ?
+                     RETURN_CODE_SUCCESS : RETURN_CODE_VERIFY_FAILED);
+}
+
+static void drop_transfer()
+{
+    write_len = 0;
+    staged_len = 0;
+}
+
+static return_code_t stage(const uint8_t *data, unsigned len)
+{
+    memcpy(&write_buf[staged_len], data, len);
+    write_crc = crc16_update(write_crc, data, len);
+    staged_len += len;
+
+    if (staged_len < write_len)
+        return RETURN_CODE_SUCCESS; // more packets to come
+
+    // (host commands are held off until the previous transfer is done)
+    if (target_xact_pending()) {
+        drop_transfer();
+        return RETURN_CODE_BUSY;
+    }
+
+#ifdef CONFIG_TARGET_MEM_CACHE
+    mem_cache_invalidate();
+#endif
+
+    chunks_in_flight = 0;
+    write_failed = false;
+    start_phase(WRITE_PHASE_WRITE);
+    return RETURN_CODE_SUCCESS;
+}
+
+return_code_t mem_write_start(uint32_t address, unsigned len,
+                              const uint8_t *data, unsigned data_len)
+{
+    drop_transfer(); // if one was being staged
+
+    if (len == 0 || len > sizeof(write_buf) || data_len > len)
+        return RETURN_CODE_INVALID_ARGS;
+
+    write_address = address;
+    write_len = len;
+    write_crc = CRC16_INIT;
+    return stage(data, data_len);
+}
+
+return_code_t mem_write_append(unsigned offset, const uint8_t *data, unsigned data_len)
+{
+    if (staged_len == write_len || offset != staged_len ||
+        data_len == 0 || data_len > write_len - staged_len) {
+        drop_transfer(); // the host starts over
+        return RETURN_CODE_INVALID_ARGS;
+    }
+
+    return stage(data, data_len);
+}
@@ -0,0 +1,34 @@
+#ifndef MEM_WRITE_H
+#define MEM_WRITE_H
+
+#include <stdint.h>
+
+#include "host_comm.h"
+
+/**
+ * @brief   Start a transfer of a block of bytes into target memory
+ * @param   len         Number of bytes, at most CONFIG_MEM_WRITE_STAGING_LEN
+ * @param   data        First bytes of the block (copied, may be reused on return)
+ * @param   data_len    Number of bytes in data, the rest follows by
+ *                      mem_write_append
+ * @return  RETURN_CODE_SUCCESS if the bytes were staged: once the block is
+ *          complete, one return code for the whole transfer is sent to host.
+ * @details The block is staged, then split into writes that fit into a
+ *          target command, with up to CONFIG_MEM_WRITE_PIPELINE_DEPTH in
+ *          flight. The written range is then read back (in chunks of
+ *          CONFIG_MEM_WRITE_VERIFY_CHUNK_LEN, pipelined likewise) and its CRC
+ *          compared with the CRC of the block. Starting a transfer drops any
+ *          transfer not yet fully staged.
+ */
+return_code_t mem_write_start(uint32_t address, unsigned len,
+                              const uint8_t *data, unsigned data_len);
+
+/**
+ * @brief   Stage more bytes of the transfer started by mem_write_start
+ * @param   offset  Of the bytes in the block: must follow the bytes staged
+ * @return  RETURN_CODE_SUCCESS as for mem_write_start. On error, the
+ *          transfer is dropped.
+ */
+return_code_t mem_write_append(unsigned offset, const uint8_t *data, unsigned data_len);
+
+#endif // MEM_WRITE_H
@@ -1,9 +1,12 @@
 #include "params.h"
+#include "config.h"
 
 uint16_t param_test = 0xbeef;
 uint16_t param_target_boot_voltage_dl = 2745; // = 2.0v * (4096 / EDB_VDD)
 uint16_t param_target_boot_latency_kcycles = 24; // = 24 MHz * 1ms
 uint16_t param_num_watchpoint_events_buffered = 16; // must <= MAX_WATCHPOINT_EVENTS_BUFFERED
+uint16_t param_num_adc_buffers = 2; // must be in [2, CONFIG_ADC_MAX_BUFFERS]
+uint16_t param_num_adc_samples_buffered = 32; // must be in [1, MAX_ADC_SAMPLES_BUFFERED]
 
 static unsigned serialize_uint16(uint8_t *buf, uint16_t value)
 {
@@ -48,6 +51,8 @@ static unsigned deserialize_frac(float *frac, uint8_t *buf)
 
 return_code_t set_param(param_t param, uint8_t *buf)
 {
+    uint16_t value;
+
     switch (param) {
         case PARAM_TEST:
             deserialize_uint16(&param_test, buf);
@@ -63,6 +68,18 @@ return_code_t set_param(param_t param, uint8_t *buf)
                 return RETURN_CODE_INVALID_ARGS;
             deserialize_uint16(&param_num_watchpoint_events_buffered, buf);
             break;
+        case PARAM_NUM_ADC_BUFFERS:
+            deserialize_uint16(&value, buf);
+            if (value < 2 || value > CONFIG_ADC_MAX_BUFFERS)
+                return RETURN_CODE_INVALID_ARGS;
+            param_num_adc_buffers = value;
+            break;
+        case PARAM_NUM_ADC_SAMPLES_BUFFERED:
+            deserialize_uint16(&value, buf);
+            if (value == 0 || value > MAX_ADC_SAMPLES_BUFFERED)
+                return RETURN_CODE_INVALID_ARGS;
+            param_num_adc_samples_buffered = value;
+            break;
         default:
             return RETURN_CODE_INVALID_ARGS;
     }
@@ -81,6 +98,10 @@ unsigned get_param(param_t param, uint8_t *buf)
             return serialize_uint16(buf, param_target_boot_latency_kcycles);
         case PARAM_NUM_WATCHPOINT_EVENTS_BUFFERED:
             return serialize_uint16(buf, param_num_watchpoint_events_buffered);
+        case PARAM_NUM_ADC_BUFFERS:
+            return serialize_uint16(buf, param_num_adc_buffers);
+        case PARAM_NUM_ADC_SAMPLES_BUFFERED:
+            return serialize_uint16(buf, param_num_adc_samples_buffered);
         default:
             return 0;
     }
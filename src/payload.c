@@ -0,0 +1,163 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <msp430.h>
+
+#include "config.h"
+#include "pin_assign.h"
+#include "systick.h"
+#include "adc.h"
+#include "uart.h"
+#include "host_comm.h"
+
+#include "payload.h"
+
+#ifndef CONFIG_SYSTICK_32BIT
+#error Periodic payload requires 32-bit systick: CONFIG_SYSTICK_32BIT
+#endif
+
+#define PAYLOAD_WATCHPOINTS NUM_CODEPOINT_PINS
+
+/**
+ * @brief Record layout (little-endian, no padding)
+ */
+#define PAYLOAD_SEQ_OFFSET          0  // uint16: records sent so far
+#define PAYLOAD_VCAP_MIN_OFFSET     2  // uint16: ADC reading
+#define PAYLOAD_VCAP_MAX_OFFSET     4  // uint16: ADC reading
+#define PAYLOAD_VCAP_AVG_OFFSET     6  // uint16: ADC reading
+#define PAYLOAD_WATCHPOINTS_OFFSET  8  // uint16 per watchpoint: hits
+#define PAYLOAD_APP_OUTPUT_LEN_OFFSET \
+    (PAYLOAD_WATCHPOINTS_OFFSET + PAYLOAD_WATCHPOINTS * sizeof(uint16_t)) // uint8
+#define PAYLOAD_APP_OUTPUT_OFFSET   (PAYLOAD_APP_OUTPUT_LEN_OFFSET + 1)
+#define PAYLOAD_RECORD_LEN          (PAYLOAD_APP_OUTPUT_OFFSET + CONFIG_PAYLOAD_APP_OUTPUT_LEN)
+
+static uint8_t payload_record[PAYLOAD_RECORD_LEN];
+static volatile bool payload_record_busy; // on the wire to host
+
+static uint32_t payload_period; // zero if disabled
+static uint32_t payload_start; // of the current interval
+static uint32_t payload_last_sample;
+static uint16_t payload_seq;
+
+// Summary of the current interval
+static uint16_t vcap_min, vcap_max;
+static uint32_t vcap_sum;
+static uint16_t vcap_samples;
+static volatile uint16_t watchpoint_hits[PAYLOAD_WATCHPOINTS];
+static uint8_t app_output[CONFIG_PAYLOAD_APP_OUTPUT_LEN];
+static unsigned app_output_len;
+
+static void on_payload_sent(uint8_t *buf)
+{
+    payload_record_busy = false;
+}
+
+static inline void put_u16(unsigned offset, uint16_t value)
+{
+    payload_record[offset + 0] = value & 0xff;
+    payload_record[offset + 1] = value >> 8;
+}
+
+static void reset_interval(uint32_t now)
+{
+    uint16_t sr;
+    unsigned i;
+
+    payload_start = now;
+    payload_last_sample = now;
+
+    vcap_min = 0xffff;
+    vcap_max = 0;
+    vcap_sum = 0;
+    vcap_samples = 0;
+
+    sr = __get_SR_register();
+    __disable_interrupt(); // counted from ISRs
+    for (i = 0; i < PAYLOAD_WATCHPOINTS; ++i)
+        watchpoint_hits[i] = 0;
+    __bis_SR_register(sr & GIE); // restore the caller's interrupt state
+
+    // app output is kept: it is the latest, not per interval
+}
+
+static void sample_energy()
+{
+    uint16_t vcap = ADC_read(ADC_CHAN_INDEX_VCAP);
+
+    if (vcap < vcap_min)
+        vcap_min = vcap;
+    if (vcap > vcap_max)
+        vcap_max = vcap;
+    vcap_sum += vcap;
+    vcap_samples++;
+}
+
+static void send_record()
+{
+    unsigned i;
+
+    while (payload_record_busy); // the period is much longer than the TX
+
+    if (vcap_samples == 0) // period shorter than the sampling interval
+        sample_energy();
+
+    put_u16(PAYLOAD_SEQ_OFFSET, payload_seq++);
+    put_u16(PAYLOAD_VCAP_MIN_OFFSET, vcap_min);
+    put_u16(PAYLOAD_VCAP_MAX_OFFSET, vcap_max);
+    put_u16(PAYLOAD_VCAP_AVG_OFFSET, vcap_sum / vcap_samples);
+    for (i = 0; i < PAYLOAD_WATCHPOINTS; ++i)
+        put_u16(PAYLOAD_WATCHPOINTS_OFFSET + i * sizeof(uint16_t), watchpoint_hits[i]);
+
+    payload_record[PAYLOAD_APP_OUTPUT_LEN_OFFSET] = app_output_len;
+    memcpy(&payload_record[PAYLOAD_APP_OUTPUT_OFFSET], app_output, app_output_len);
+    memset(&payload_record[PAYLOAD_APP_OUTPUT_OFFSET + app_output_len], 0,
+           CONFIG_PAYLOAD_APP_OUTPUT_LEN - app_output_len);
+
+    payload_record_busy = true;
+    UART_send_msg_to_host(USB_RSP_ENERGY_PROFILE, PAYLOAD_RECORD_LEN,
+                          payload_record, on_payload_sent);
+}
+
+return_code_t payload_set_period(uint32_t period)
+{
+    payload_period = period;
+    payload_seq = 0;
+    reset_interval(SYSTICK_CURRENT_TIME);
+    return RETURN_CODE_SUCCESS;
+}
+
+void payload_record_app_output(uint8_t *data, unsigned len)
+{
+    if (len > CONFIG_PAYLOAD_APP_OUTPUT_LEN)
+        len = CONFIG_PAYLOAD_APP_OUTPUT_LEN;
+
+    memcpy(app_output, data, len);
+    app_output_len = len;
+}
+
+void payload_record_watchpoint(unsigned index)
+{
+    if (index < PAYLOAD_WATCHPOINTS && watchpoint_hits[index] != 0xffff) // saturate
+        watchpoint_hits[index]++;
+}
+
+void payload_service()
+{
+    uint32_t now;
+
+    if (payload_period == 0)
+        return;
+
+    now = SYSTICK_CURRENT_TIME;
+
+    if (now - payload_last_sample >= CONFIG_PAYLOAD_ENERGY_SAMPLE_TICKS) {
+        payload_last_sample = now;
+        sample_energy();
+    }
+
+    if (now - payload_start >= payload_period) {
+        send_record();
+        reset_interval(now);
+    }
+}
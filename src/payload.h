@@ -0,0 +1,34 @@
+#ifndef PAYLOAD_H
+#define PAYLOAD_H
+
+#include <stdint.h>
+
+#include "host_comm.h"
+
+/**
+ * @brief   Start or stop sending a payload record every period
+ * @param   period  Interval between records, in systick ticks (0 stops)
+ * @details Each record summarizes the interval: Vcap (sampled every
+ *          CONFIG_PAYLOAD_ENERGY_SAMPLE_TICKS), the number of hits of each
+ *          watchpoint, and the latest output pushed by the target app.
+ *          Records are sent as USB_RSP_ENERGY_PROFILE messages.
+ */
+return_code_t payload_set_period(uint32_t period);
+
+/**
+ * @brief   Keep the latest output pushed by the target app (truncated)
+ */
+void payload_record_app_output(uint8_t *data, unsigned len);
+
+/**
+ * @brief   Count a watchpoint hit (called from ISR)
+ */
+void payload_record_watchpoint(unsigned index);
+
+/**
+ * @brief   Sample the energy level and send the record when due
+ * @details Called from the main loop.
+ */
+void payload_service();
+
+#endif // PAYLOAD_H
@@ -16,35 +16,24 @@
 #include "error.h"
 #include "rfid_decoder.h"
 #include "main_loop.h"
+#include "stream.h"
 
 #include "rfid.h"
 
-/*Buffer structure:
- *  [ empty_space | header | rf_event_t #1 | rf_event_t #2 | ... | rf_event_t #n ]
- * where len(empty_space + header) == sizeof(rf_event_t) because compiler might
- * have alignment rules for structs: can't treat any memory address as pointer to
- * a struct (this is a hypothesis, though).
+/* Buffer structure:
+ *  header:  [ stream msg header ]
+ *  events:  [ rf_event_t #1 | rf_event_t #2 | ... | rf_event_t #n ]
  *
- * Note that rf_event_t items include padding from the struct.
+ * The header and the events are kept in separate arrays and are gathered into
+ * one UART message when sent, so the events array can be a plain array of
+ * structs, with no space to reserve in front of it.
  *
- * The bytes sent in the UART message start at header.
+ * Note that rf_event_t items include padding from the struct.
  */
 
 #define NUM_BUFFERS                                  2 // double-buffer pair
 #define NUM_EVENTS_BUFFERED                         16
 
-#define RF_EVENT_BUF_HEADER_SPACE 2 // units of sizeof(rf_event_t)
-#define RF_EVENT_BUF_PAYLOAD_SPACE NUM_EVENTS_BUFFERED // units of sizeof(rf_event_t)
-#define RF_EVENT_BUF_SIZE (RF_EVENT_BUF_HEADER_SPACE + RF_EVENT_BUF_PAYLOAD_SPACE) // units of sizeof(rf_event_t)
-
-#if STREAM_DATA_MSG_HEADER > RF_EVENT_BUF_HEADER_SPACE
-#error Not enough space for header in event buf: add more units of sizeof(struct rf_event_t)
-#endif
-
-#define RF_EVENT_BUF_HEADER_OFFSET \
-    (RF_EVENT_BUF_HEADER_SPACE * sizeof(rf_event_t) - \
-        (UART_MSG_HEADER_SIZE + STREAM_DATA_MSG_HEADER_LEN))
-
 #define STARTING_EVENT_BUF_IDX 0
 
 typedef struct {
@@ -52,21 +41,9 @@ typedef struct {
     rf_event_type_t id;
 } rf_event_t;
 
-/** @brief Memory allocated for the double-buffer pair
- *
- *  @details To avoid an extra copy, the event buffer is contiguous with
- *           memory for the other message fields.
- */
-static rf_event_t rf_events_msg_bufs[NUM_BUFFERS][RF_EVENT_BUF_SIZE];
-
-/** @brief Pointers to each event buffer in the double-buffer pair
- *  @details These pointers point to the event data "payload" of the message,
- *           skipping the other message fields.
- */
-static rf_event_t * const rf_events_bufs[NUM_BUFFERS] = {
-    (rf_event_t *)&rf_events_msg_bufs[0][RF_EVENT_BUF_HEADER_SPACE],
-    (rf_event_t *)&rf_events_msg_bufs[1][RF_EVENT_BUF_HEADER_SPACE]
-};
+/** @brief Memory allocated for the double-buffer pair */
+static uint8_t rf_events_headers[NUM_BUFFERS][STREAM_DATA_MSG_HEADER_LEN];
+static rf_event_t rf_events_bufs[NUM_BUFFERS][NUM_EVENTS_BUFFERED];
 
 /** @brief Pointer and index to current event buffer among the double-buffer pair
  *  @details These are, strictly speaking, redundant, but improve legibility
@@ -83,16 +60,38 @@ static rf_event_t *rf_events_buf;
 static unsigned rf_events_count[NUM_BUFFERS];
 
 
+// Hand the current (full) buffer to main loop, if the other one is free
+// and the host has granted a credit for it
+static bool commit_events()
+{
+    if (rf_events_count[rf_events_buf_idx ^ 1] != 0 ||
+        !stream_take_credit(STREAM_SOURCE_RF_EVENTS))
+        return false;
+
+    rf_events_buf_idx ^= 0x1;
+    rf_events_buf = rf_events_bufs[rf_events_buf_idx];
+
+    main_loop_flags |= FLAG_RF_DATA;
+    return true;
+}
+
 static void append_event(rf_event_type_t id)
 {
     rf_event_t *rf_event;
 
+    // Committing a full buffer is retried on every event
+    if (rf_events_count[rf_events_buf_idx] == NUM_EVENTS_BUFFERED &&
+        !commit_events()) {
 #ifdef CONFIG_ABORT_ON_RFID_EVENT_OVERFLOW
-    ASSERT(ASSERT_RF_EVENTS_BUF_OVERFLOW, rf_events_count[rf_events_buf_idx] < NUM_EVENTS_BUFFERED);
-#else
-    if (rf_events_count < NUM_EVENTS_BUFFERED)
-        return;
+        ASSERT(ASSERT_RF_EVENTS_BUF_OVERFLOW, false);
 #endif
+        // the other buffer may still be on the wire: drop the event
+        stream_drop(STREAM_SOURCE_RF_EVENTS, SYSTICK_CURRENT_TIME);
+        return;
+    }
+
+    if (rf_events_count[rf_events_buf_idx] == 0)
+        stream_write_dropped(STREAM_SOURCE_RF_EVENTS, &rf_events_headers[rf_events_buf_idx][0]);
 
     rf_event = &rf_events_buf[rf_events_count[rf_events_buf_idx]];
 
@@ -104,13 +103,8 @@ static void append_event(rf_event_type_t id)
     rf_events_count[rf_events_buf_idx]++;
 
     // If full, then swap buffers
-    if (rf_events_count[rf_events_buf_idx] == NUM_EVENTS_BUFFERED) {
-        rf_events_buf_idx ^= 0x1;
-        rf_events_buf = rf_events_bufs[rf_events_buf_idx];
-
-        main_loop_flags |= FLAG_RF_DATA;
-    }
-
+    if (rf_events_count[rf_events_buf_idx] == NUM_EVENTS_BUFFERED)
+        commit_events();
 }
 
 static inline void handle_rfid_cmd(rfid_cmd_code_t cmd_code)
@@ -123,6 +117,12 @@ static inline void handle_rfid_rsp(rfid_rsp_code_t rsp_code)
     append_event(RF_EVENT_TYPE_RSP | rsp_code);
 }
 
+static void on_rf_events_sent(uint8_t *buf)
+{
+    unsigned buf_idx = (buf == &rf_events_headers[0][0]) ? 0 : 1;
+    rf_events_count[buf_idx] = 0; // mark buffer as free
+}
+
 /**
  * @brief Send collected RF events to the host via the USB UART
  *
@@ -143,20 +143,17 @@ void RFID_send_rf_events_to_host()
 {
     unsigned ready_events_count;
     unsigned ready_events_buf_idx = rf_events_buf_idx ^ 1; // the other one in the pair
+    uart_segment_t segments[2];
 
     ready_events_count = rf_events_count[ready_events_buf_idx];
 
-    UART_begin_transmission();
-
-    // Must use a blocking call in order to mark buffer as free once transfer completes
-    UART_send_msg_to_host(USB_RSP_STREAM_EVENTS,
-            // TODO: the event count is == NUM_BUFFERED_EVENTS, except for the flush case
-            STREAM_DATA_MSG_HEADER_LEN + ready_events_count * sizeof(rf_event_t),
-            (uint8_t *)&rf_events_msg_bufs[ready_events_buf_idx][0] + RF_EVENT_BUF_HEADER_OFFSET);
-
-    UART_end_transmission();
+    segments[0].buf = &rf_events_headers[ready_events_buf_idx][0];
+    segments[0].len = STREAM_DATA_MSG_HEADER_LEN;
+    segments[1].buf = (uint8_t *)&rf_events_bufs[ready_events_buf_idx][0];
+    segments[1].len = ready_events_count * sizeof(rf_event_t);
 
-    rf_events_count[ready_events_buf_idx] = 0; // mark buffer as free
+    // Buffer is marked as free once the transfer completes
+    UART_send_segments_to_host(USB_RSP_STREAM_EVENTS, segments, 2, on_rf_events_sent);
 }
 
 void RFID_init()
@@ -167,11 +164,13 @@ void RFID_init()
 
     // Initialize message header
     for (i = 0; i < NUM_BUFFERS; ++i) {
-        header = (uint8_t *)&rf_events_msg_bufs[i][0] +
-                    UART_MSG_HEADER_SIZE + RF_EVENT_BUF_HEADER_OFFSET;
+        header = &rf_events_headers[i][0];
         offset = 0;
         header[offset++] = STREAM_RF_EVENTS;
         header[offset++] = 0; // padding
+        header[offset++] = 0; // dropped count, set when buffer starts filling
+        header[offset++] = 0;
+        offset += STREAM_DATA_GAP_LEN; // gap range, set with dropped count
         ASSERT(ASSERT_INVALID_STREAM_BUF_HEADER, offset == STREAM_DATA_MSG_HEADER_LEN);
     }
 
@@ -0,0 +1,185 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <msp430.h>
+
+#include <libedb/target_comm.h>
+#include <libmsp/periph.h>
+#include <libio/log.h>
+
+#include "config.h"
+#include "pin_assign.h"
+#include "error.h"
+#include "minmax.h"
+#include "crc.h"
+#include "uart.h"
+#include "host_comm.h"
+#include "host_comm_impl.h"
+#include "target_comm_impl.h"
+#include "target_xact.h"
+
+#include "snapshot.h"
+
+#if CONFIG_SNAPSHOT_BLOCK_LEN > UART_PKT_MAX_DATA_LEN
+#error Snapshot block does not fit in a packet from target: CONFIG_SNAPSHOT_BLOCK_LEN
+#endif
+
+#if CONFIG_SNAPSHOT_MAX_BLOCKS > 32
+#error Snapshot region does not fit in the bitmap of a message: CONFIG_SNAPSHOT_MAX_BLOCKS
+#endif
+
+#if CONFIG_SNAPSHOT_FRAME_DATA_LEN < CONFIG_SNAPSHOT_BLOCK_LEN
+#error Snapshot frame is smaller than a block: CONFIG_SNAPSHOT_FRAME_DATA_LEN
+#endif
+
+typedef struct {
+    uint32_t address;
+    unsigned len; // zero if the slot is unused
+    bool hashed; // block CRCs are of the previous capture
+    uint16_t block_crcs[CONFIG_SNAPSHOT_MAX_BLOCKS];
+} snapshot_region_t;
+
+static snapshot_region_t regions[CONFIG_SNAPSHOT_REGIONS];
+
+// Buffer layout: [ region (uint8) | first block (uint8) | bitmap (uint32) | blocks ]
+// Bit i of the bitmap is set if block (first + i) is included. The message
+// covers the blocks up to the first block of the next message for the region.
+#define FRAME_HEADER_LEN 6
+
+static uint8_t frame_buf[FRAME_HEADER_LEN + CONFIG_SNAPSHOT_FRAME_DATA_LEN];
+static volatile bool frame_busy; // on the wire to host
+static unsigned frame_len; // bytes of blocks in the buffer
+static unsigned frame_cap; // max bytes of blocks for the current host link
+static unsigned frame_first_block;
+static uint32_t frame_bitmap;
+
+static unsigned snap_region; // being captured
+static unsigned snap_block; // index of the pending block
+static unsigned snap_block_len; // bytes in the pending block
+
+static void on_block(uartPkt_t *rsp, unsigned arg);
+
+static void on_frame_sent(uint8_t *buf)
+{
+    frame_busy = false;
+}
+
+static void begin_frame(unsigned first_block)
+{
+    while (frame_busy); // the host link is faster than the target link
+
+    frame_first_block = first_block;
+    frame_bitmap = 0;
+    frame_len = 0;
+}
+
+static void send_frame()
+{
+    frame_buf[0] = snap_region;
+    frame_buf[1] = frame_first_block;
+    frame_buf[2] = (frame_bitmap >> 0) & 0xff;
+    frame_buf[3] = (frame_bitmap >> 8) & 0xff;
+    frame_buf[4] = (frame_bitmap >> 16) & 0xff;
+    frame_buf[5] = (frame_bitmap >> 24) & 0xff;
+
+    frame_busy = true;
+    UART_send_msg_to_host(USB_RSP_SNAPSHOT, FRAME_HEADER_LEN + frame_len,
+                          frame_buf, on_frame_sent);
+}
+
+static void read_block()
+{
+    snapshot_region_t *region = &regions[snap_region];
+    unsigned offset = snap_block * CONFIG_SNAPSHOT_BLOCK_LEN;
+
+    snap_block_len = MIN(region->len - offset, CONFIG_SNAPSHOT_BLOCK_LEN);
+
+    ASSERT(ASSERT_TARGET_XACT_BUSY, !target_xact_pending());
+    target_xact_begin(WISP_RSP_MEMORY, CONFIG_TARGET_XACT_TIMEOUT, on_block, 0);
+    target_comm_send_read_mem(region->address + offset, snap_block_len);
+}
+
+// Start on the next region in use, from snap_region on
+static void capture_region()
+{
+    while (snap_region < CONFIG_SNAPSHOT_REGIONS && regions[snap_region].len == 0)
+        snap_region++;
+
+    if (snap_region == CONFIG_SNAPSHOT_REGIONS) { // all captured
+        send_return_code(RETURN_CODE_SUCCESS);
+        return;
+    }
+
+    snap_block = 0;
+    begin_frame(0);
+    read_block();
+}
+
+static void on_block(uartPkt_t *rsp, unsigned arg)
+{
+    snapshot_region_t *region = &regions[snap_region];
+    uint16_t crc;
+
+    if (!rsp || rsp->length != snap_block_len) {
+        LOG("snapshot: no block %u of region %u\r\n", snap_block, snap_region);
+        region->hashed = false; // send all of it next time
+        if (frame_len > 0)
+            send_frame(); // deliver the blocks read so far
+        send_return_code(RETURN_CODE_COMM_ERROR);
+        return;
+    }
+
+    crc = crc16_update(CRC16_INIT, rsp->data, rsp->length);
+    if (!region->hashed || crc != region->block_crcs[snap_block]) {
+        region->block_crcs[snap_block] = crc;
+
+        if (frame_len + snap_block_len > frame_cap) {
+            send_frame();
+            begin_frame(snap_block);
+        }
+
+        memcpy(&frame_buf[FRAME_HEADER_LEN + frame_len], rsp->data, rsp->length);
+        frame_len += rsp->length;
+        frame_bitmap |= (uint32_t)1 << (snap_block - frame_first_block);
+    }
+
+    snap_block++;
+    if (snap_block * CONFIG_SNAPSHOT_BLOCK_LEN < region->len) {
+        read_block();
+        return;
+    }
+
+    send_frame();
+    region->hashed = true;
+
+    snap_region++;
+    capture_region();
+}
+
+return_code_t snapshot_set_region(unsigned index, uint32_t address, unsigned len)
+{
+    if (index >= CONFIG_SNAPSHOT_REGIONS ||
+        len > CONFIG_SNAPSHOT_MAX_BLOCKS * CONFIG_SNAPSHOT_BLOCK_LEN)
+        return RETURN_CODE_INVALID_ARGS;
+
+    regions[index].address = address;
+    regions[index].len = len;
+    regions[index].hashed = false;
+    return RETURN_CODE_SUCCESS;
+}
+
+void snapshot_start()
+{
+    unsigned i;
+
+    for (i = 0; i < CONFIG_SNAPSHOT_REGIONS && regions[i].len == 0; ++i);
+    if (i == CONFIG_SNAPSHOT_REGIONS)
+        return; // nothing to capture, so nothing to tell the host
+
+    frame_cap = MIN(CONFIG_SNAPSHOT_FRAME_DATA_LEN,
+                    UART_host_max_payload_len() - FRAME_HEADER_LEN);
+
+    snap_region = 0;
+    capture_region();
+}
@@ -0,0 +1,33 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdint.h>
+
+#include "host_comm.h"
+
+/**
+ * @brief   Set a range of target memory to capture on each debug mode entry
+ * @param   index   Region slot, less than CONFIG_SNAPSHOT_REGIONS
+ * @param   len     Number of bytes, zero to clear the slot
+ * @details The first capture after setting a region sends all of it.
+ */
+return_code_t snapshot_set_region(unsigned index, uint32_t address, unsigned len);
+
+/**
+ * @brief   Capture the snapshot regions and send what changed to host
+ * @details Each region is read from the target in blocks of
+ *          CONFIG_SNAPSHOT_BLOCK_LEN, by transactions that run from the main
+ *          loop. Blocks with a CRC different from the previous capture are
+ *          sent in USB_RSP_SNAPSHOT messages, with a bitmap of the blocks
+ *          included. At least one message is sent per region, so an
+ *          unchanged region is reported by an empty bitmap. A return code
+ *          follows the last message: RETURN_CODE_SUCCESS once all regions
+ *          are captured, or RETURN_CODE_COMM_ERROR if a block could not be
+ *          read, after the blocks read so far. Nothing is sent if no region
+ *          is set.
+ *
+ *          A change that leaves the CRC of the block the same goes unnoticed.
+ */
+void snapshot_start();
+
+#endif // SNAPSHOT_H
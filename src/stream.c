@@ -0,0 +1,59 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <msp430.h>
+
+#include "host_comm.h"
+
+#include "stream.h"
+
+volatile uint16_t stream_credits[NUM_STREAM_SOURCES] = {
+    STREAM_CREDITS_UNLIMITED,
+    STREAM_CREDITS_UNLIMITED,
+    STREAM_CREDITS_UNLIMITED,
+};
+volatile uint16_t stream_dropped[NUM_STREAM_SOURCES];
+volatile uint32_t stream_gap_start[NUM_STREAM_SOURCES];
+volatile uint32_t stream_gap_end[NUM_STREAM_SOURCES];
+
+// Map from stream source to the stream bits it produces
+static const uint16_t source_streams[NUM_STREAM_SOURCES] = {
+    ADC_STREAMS,
+    STREAM_RF_EVENTS,
+    STREAM_WATCHPOINTS,
+};
+
+void stream_grant_credits(uint16_t streams, uint16_t credits)
+{
+    unsigned i;
+    uint32_t total;
+    uint16_t sr;
+
+    for (i = 0; i < NUM_STREAM_SOURCES; ++i) {
+        if (!(streams & source_streams[i]))
+            continue;
+
+        // credits are consumed from ISRs
+        sr = __get_SR_register();
+        __disable_interrupt();
+        if (credits == STREAM_CREDITS_UNLIMITED ||
+            stream_credits[i] == STREAM_CREDITS_UNLIMITED) {
+            stream_credits[i] = credits;
+        } else {
+            total = (uint32_t)stream_credits[i] + credits;
+            stream_credits[i] = total < STREAM_CREDITS_UNLIMITED ?
+                total : STREAM_CREDITS_UNLIMITED - 1;
+        }
+        __bis_SR_register(sr & GIE); // restore the caller's interrupt state
+    }
+}
+
+void stream_reset_drops(uint16_t streams)
+{
+    unsigned i;
+
+    for (i = 0; i < NUM_STREAM_SOURCES; ++i) {
+        if (streams & source_streams[i])
+            stream_dropped[i] = 0;
+    }
+}
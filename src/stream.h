@@ -0,0 +1,109 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "host_comm.h"
+
+/**
+ * @brief Producers of stream data, each sends its own frames
+ */
+typedef enum {
+    STREAM_SOURCE_ADC = 0,
+    STREAM_SOURCE_RF_EVENTS,
+    STREAM_SOURCE_WATCHPOINTS,
+
+    NUM_STREAM_SOURCES
+} stream_source_t;
+
+/**
+ * @brief Credit value that disables flow control for a stream source
+ */
+#define STREAM_CREDITS_UNLIMITED 0xFFFF
+
+// Remaining frame credits and items dropped since last frame, per source
+extern volatile uint16_t stream_credits[NUM_STREAM_SOURCES];
+extern volatile uint16_t stream_dropped[NUM_STREAM_SOURCES];
+// Timestamps of the first and last item dropped since last frame, per source
+extern volatile uint32_t stream_gap_start[NUM_STREAM_SOURCES];
+extern volatile uint32_t stream_gap_end[NUM_STREAM_SOURCES];
+
+/**
+ * @brief Add frame credits to the sources of the given streams
+ * @param streams   Bitmask of stream_t
+ * @param credits   Number of frames, or STREAM_CREDITS_UNLIMITED
+ * @details Sources start with unlimited credits. The first grant switches a
+ *          source to flow-controlled mode, until unlimited credits are
+ *          granted again.
+ */
+void stream_grant_credits(uint16_t streams, uint16_t credits);
+
+/**
+ * @brief Clear the drop counters of the sources of the given streams
+ */
+void stream_reset_drops(uint16_t streams);
+
+/**
+ * @brief Consume a credit for a frame about to be committed for sending
+ * @return Whether the frame may be sent
+ * @details Called by producers (from ISRs) when a buffer is full.
+ */
+static inline bool stream_take_credit(stream_source_t source)
+{
+    uint16_t credits = stream_credits[source];
+
+    if (credits == STREAM_CREDITS_UNLIMITED)
+        return true;
+    if (credits == 0)
+        return false;
+    stream_credits[source] = credits - 1;
+    return true;
+}
+
+/**
+ * @brief Count an item that a producer had no buffer space for
+ * @param timestamp Time of the dropped item, extends the current gap
+ */
+static inline void stream_drop(stream_source_t source, uint32_t timestamp)
+{
+    if (stream_dropped[source] == 0)
+        stream_gap_start[source] = timestamp;
+    stream_gap_end[source] = timestamp;
+
+    if (stream_dropped[source] != 0xFFFF) // saturate
+        stream_dropped[source]++;
+}
+
+static inline void stream_write_uint32(uint8_t *buf, uint32_t value)
+{
+    buf[0] = value & 0xff;
+    buf[1] = (value >> 8) & 0xff;
+    buf[2] = (value >> 16) & 0xff;
+    buf[3] = (value >> 24) & 0xff;
+}
+
+/**
+ * @brief Move the drop count and the gap range into the header of a frame
+ * @param header    Pointer to the stream data message header
+ * @details Called when the first item is stored into a buffer, so that the
+ *          count is of items lost right before the first item in the frame.
+ */
+static inline void stream_write_dropped(stream_source_t source, uint8_t *header)
+{
+    uint16_t dropped = stream_dropped[source];
+    uint32_t gap_start = 0, gap_end = 0;
+
+    if (dropped) {
+        gap_start = stream_gap_start[source];
+        gap_end = stream_gap_end[source];
+    }
+
+    header[STREAM_DATA_DROPPED_OFFSET + 0] = dropped & 0xff;
+    header[STREAM_DATA_DROPPED_OFFSET + 1] = dropped >> 8;
+    stream_write_uint32(&header[STREAM_DATA_GAP_OFFSET], gap_start);
+    stream_write_uint32(&header[STREAM_DATA_GAP_OFFSET + sizeof(uint32_t)], gap_end);
+    stream_dropped[source] = 0;
+}
+
+#endif // STREAM_H
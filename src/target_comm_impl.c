@@ -25,9 +25,18 @@ static uint8_t * const target_msg_payload = &target_msg_buf[UART_MSG_HEADER_SIZE
 
 uartPkt_t wispRxPkt = { .processed = 1 };
 
+// The previous message may still be going out of the buffer
+static inline void begin_msg_to_target()
+{
+    while (target_uart_status & UART_STATUS_TX_BUSY);
+}
+
 void target_comm_send_breakpoint(uint8_t index, bool enable)
 {
     unsigned payload_len = 0;
+
+    begin_msg_to_target();
+
     target_msg_payload[payload_len++] = index;
     target_msg_payload[payload_len++] = enable ? 0x1 : 0x0;
 
@@ -52,6 +61,9 @@ void target_comm_send_exit_debug_mode()
 void target_comm_send_read_mem(uint32_t address, unsigned len)
 {
     unsigned payload_len = 0;
+
+    begin_msg_to_target();
+
     target_msg_payload[payload_len++] = (address >> 0) & 0xff;
     target_msg_payload[payload_len++] = (address >> 8) & 0xff;
     target_msg_payload[payload_len++] = (address >> 16) & 0xff;
@@ -66,6 +78,8 @@ void target_comm_send_write_mem(uint32_t address, uint8_t *value, unsigned len)
     unsigned i;
     unsigned payload_len = 0;
 
+    begin_msg_to_target();
+
     target_msg_payload[payload_len++] = (address >> 0) & 0xff;
     target_msg_payload[payload_len++] = (address >> 8) & 0xff;
     target_msg_payload[payload_len++] = (address >> 16) & 0xff;
@@ -83,6 +97,9 @@ void target_comm_send_write_mem(uint32_t address, uint8_t *value, unsigned len)
 void target_comm_send_echo(uint8_t value)
 {
     unsigned payload_len = 0;
+
+    begin_msg_to_target();
+
     target_msg_payload[payload_len++] = value;
     UART_send_msg_to_target(WISP_CMD_SERIAL_ECHO, payload_len, target_msg_buf);
 }
@@ -91,3 +108,19 @@ void target_comm_send_get_app_output()
 {
     UART_send_msg_to_target(WISP_CMD_GET_APP_OUTPUT, 0, target_msg_buf);
 }
+
+#ifdef CONFIG_TARGET_UART_BAUDRATE_NEGOTIATION
+void target_comm_send_set_baudrate(uint32_t baudrate)
+{
+    unsigned payload_len = 0;
+
+    begin_msg_to_target();
+
+    target_msg_payload[payload_len++] = (baudrate >> 0) & 0xff;
+    target_msg_payload[payload_len++] = (baudrate >> 8) & 0xff;
+    target_msg_payload[payload_len++] = (baudrate >> 16) & 0xff;
+    target_msg_payload[payload_len++] = (baudrate >> 24) & 0xff;
+
+    UART_send_msg_to_target(WISP_CMD_SET_BAUDRATE, payload_len, target_msg_buf);
+}
+#endif // CONFIG_TARGET_UART_BAUDRATE_NEGOTIATION
@@ -0,0 +1,92 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <msp430.h>
+
+#include "config.h"
+#include "minmax.h"
+#include "systick.h"
+#include "uart.h"
+#include "host_comm.h"
+
+#include "target_stdio.h"
+
+#define STDIO_DROPPED_LEN 2 // uint16
+#define STDIO_RECORD_HEADER_LEN 5 // uint32 + uint8
+
+#if CONFIG_TARGET_STDIO_FRAME_LEN < STDIO_DROPPED_LEN + STDIO_RECORD_HEADER_LEN + UART_PKT_MAX_DATA_LEN
+#error Target STDIO message does not fit a packet from target: CONFIG_TARGET_STDIO_FRAME_LEN
+#endif
+
+// Buffer layout: [ bytes dropped before (uint16) | records ]
+// Record layout: [ timestamp (uint32) | length (uint8) | bytes ]
+static uint8_t stdio_bufs[2][CONFIG_TARGET_STDIO_FRAME_LEN]; // double-buffer pair
+static volatile bool stdio_buf_busy[2]; // on the wire to host
+static unsigned stdio_buf_idx; // buffer being filled
+static unsigned stdio_buf_len = STDIO_DROPPED_LEN; // bytes in the buffer being filled
+static uint16_t stdio_first_time; // arrival of the oldest record (low bits)
+static uint16_t stdio_dropped;
+
+static void on_stdio_frame_sent(uint8_t *buf)
+{
+    unsigned buf_idx = (buf == &stdio_bufs[0][0]) ? 0 : 1;
+    stdio_buf_busy[buf_idx] = false;
+}
+
+static void flush()
+{
+    if (stdio_buf_len == STDIO_DROPPED_LEN)
+        return; // no records
+
+    stdio_buf_busy[stdio_buf_idx] = true;
+    UART_send_msg_to_host(USB_RSP_STDIO_RECORDS, stdio_buf_len,
+                          &stdio_bufs[stdio_buf_idx][0], on_stdio_frame_sent);
+
+    stdio_buf_idx ^= 1;
+    stdio_buf_len = STDIO_DROPPED_LEN;
+}
+
+void target_stdio_append(uartPkt_t *pkt)
+{
+    uint32_t timestamp = SYSTICK_CURRENT_TIME;
+    unsigned record_len = STDIO_RECORD_HEADER_LEN + pkt->length;
+    unsigned frame_cap = MIN(CONFIG_TARGET_STDIO_FRAME_LEN, UART_host_max_payload_len());
+    uint8_t *buf;
+
+    if (stdio_buf_len + record_len > frame_cap)
+        flush();
+
+    if (stdio_buf_busy[stdio_buf_idx]) { // both buffers are going out
+        stdio_dropped = (0xffff - stdio_dropped > pkt->length) ?
+                        stdio_dropped + pkt->length : 0xffff;
+        return;
+    }
+
+    buf = &stdio_bufs[stdio_buf_idx][0];
+
+    if (stdio_buf_len == STDIO_DROPPED_LEN) {
+        buf[0] = stdio_dropped & 0xff;
+        buf[1] = stdio_dropped >> 8;
+        stdio_dropped = 0;
+        stdio_first_time = timestamp;
+    }
+
+    buf += stdio_buf_len;
+    buf[0] = (timestamp >> 0) & 0xff;
+    buf[1] = (timestamp >> 8) & 0xff;
+    buf[2] = (timestamp >> 16) & 0xff;
+    buf[3] = (timestamp >> 24) & 0xff;
+    buf[4] = pkt->length;
+    memcpy(&buf[STDIO_RECORD_HEADER_LEN], pkt->data, pkt->length);
+
+    stdio_buf_len += record_len;
+}
+
+void target_stdio_service()
+{
+    uint16_t age = (uint16_t)SYSTICK_CURRENT_TIME - stdio_first_time;
+
+    if (stdio_buf_len > STDIO_DROPPED_LEN && age >= CONFIG_TARGET_STDIO_FLUSH_AGE)
+        flush();
+}
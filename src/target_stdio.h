@@ -0,0 +1,22 @@
+#ifndef TARGET_STDIO_H
+#define TARGET_STDIO_H
+
+#include "uart.h"
+
+/**
+ * @brief   Add the bytes of a STDIO packet from target to the next message
+ * @details The bytes are copied (the packet can be released on return) and
+ *          tagged with the time of arrival. Messages to host are sent when
+ *          the next packet does not fit or by target_stdio_service. If both
+ *          buffers are on the wire to host, the bytes are dropped and counted
+ *          in the next message.
+ */
+void target_stdio_append(uartPkt_t *pkt);
+
+/**
+ * @brief   Send the bytes collected so far if the oldest is old enough
+ * @details Called from the main loop, see CONFIG_TARGET_STDIO_FLUSH_AGE.
+ */
+void target_stdio_service();
+
+#endif // TARGET_STDIO_H
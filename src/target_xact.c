@@ -0,0 +1,225 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <msp430.h>
+
+#include <libio/log.h>
+
+#include <libmsp/periph.h>
+
+#include "config.h"
+#include "pin_assign.h"
+#include "error.h"
+#include "uart.h"
+#include "main_loop.h"
+#include "target_comm_impl.h"
+
+#include "target_xact.h"
+
+#define TIMER_XACT CONCAT(TIMER_XACT_TYPE, TIMER_XACT_IDX)
+
+// The timeout compare runs on the free-running systick timer
+#if CONFIG_TIMELOG_TIMER_SOURCE == TASSEL__ACLK
+#define XACT_TIMER_CLK_FREQ CONFIG_ACLK_FREQ
+#elif CONFIG_TIMELOG_TIMER_SOURCE == TASSEL__SMCLK
+#define XACT_TIMER_CLK_FREQ CONFIG_SMCLK_FREQ
+#else
+#error Target xact timeout: unsupported systick clock source
+#endif
+
+#define XACT_TIMER_TICKS_PER_MS \
+    (XACT_TIMER_CLK_FREQ / CONFIG_TIMELOG_TIMER_DIV / CONFIG_TIMELOG_TIMER_DIV_EX / 1000)
+
+static bool xact_pending = false;
+static unsigned xact_rsp_descriptor;
+static target_xact_cb_t *xact_cb;
+static unsigned xact_arg;
+static unsigned xact_seq;
+static unsigned xact_timeout;
+static unsigned xact_outstanding; // requests not yet answered
+static unsigned xact_tag; // of the oldest request not yet answered
+static unsigned last_tag = 0; // of the last request sent
+
+/** @brief Timer periods left to count before the timeout compare fires */
+static volatile unsigned xact_timer_periods;
+
+/**
+ * @brief Responses expected from requests that timed out
+ * @details Only needed for targets that leave the tag at zero in their
+ *          responses: the first untagged responses with this descriptor are
+ *          taken to be the late ones and dropped.
+ */
+static unsigned late_rsp_descriptor;
+static unsigned late_rsps = 0;
+static bool dropped_late_rsp; // during the pending transaction
+
+// One byte in the header: zero means untagged
+static inline unsigned tag_after(unsigned tag)
+{
+    return tag < 0xff ? tag + 1 : 1;
+}
+
+static void start_timeout(unsigned timeout)
+{
+    uint32_t ticks = (uint32_t)timeout * XACT_TIMER_TICKS_PER_MS;
+
+    // The compare matches once per timer period: count whole periods first
+    xact_timer_periods = ticks >> 16;
+    if ((uint16_t)ticks == 0 && xact_timer_periods > 0)
+        xact_timer_periods--;
+
+    TIMER_CC(TIMER_XACT, TIMER_XACT_CCR, CCR) =
+        TIMER(TIMER_XACT, R) + (uint16_t)ticks;
+    TIMER_CC(TIMER_XACT, TIMER_XACT_CCR, CCTL) &= ~CCIFG;
+    TIMER_CC(TIMER_XACT, TIMER_XACT_CCR, CCTL) |= CCIE;
+}
+
+static void stop_timeout()
+{
+    TIMER_CC(TIMER_XACT, TIMER_XACT_CCR, CCTL) &= ~(CCIE | CCIFG);
+    main_loop_flags &= ~FLAG_TARGET_XACT_TIMEOUT; // in case it already fired
+}
+
+static void run_cb(uartPkt_t *rsp)
+{
+    unsigned saved_seq = host_msg_seq;
+
+    host_msg_seq = xact_seq;
+    xact_cb(rsp, xact_arg);
+    host_msg_seq = saved_seq;
+}
+
+static void finish_xact(uartPkt_t *rsp)
+{
+    xact_pending = false;
+    run_cb(rsp);
+}
+
+void target_xact_init()
+{
+#ifndef CONFIG_SYSTICK
+    // Without systick, nobody else runs the timer (never stopped after this)
+    TIMER(TIMER_XACT, CTL) = TACLR | CONFIG_TIMELOG_TIMER_SOURCE |
+                             TIMER_DIV_BITS(CONFIG_TIMELOG_TIMER_DIV);
+    TIMER(TIMER_XACT, EX0) = TIMER_A_DIV_EX_BITS(CONFIG_TIMELOG_TIMER_DIV_EX);
+    TIMER(TIMER_XACT, CTL) |= MC__CONTINUOUS;
+#endif // !CONFIG_SYSTICK
+}
+
+return_code_t target_xact_begin(unsigned rsp_descriptor, unsigned timeout,
+                                target_xact_cb_t *cb, unsigned arg)
+{
+    // One transaction at a time: the caller retries later (or reports BUSY
+    // to host). Callbacks may chain the next transaction, since the
+    // transaction is no longer pending when the last response is handled.
+    if (xact_pending)
+        return RETURN_CODE_BUSY;
+
+    xact_rsp_descriptor = rsp_descriptor;
+    xact_cb = cb;
+    xact_arg = arg;
+    xact_seq = host_msg_seq;
+    xact_timeout = timeout;
+    xact_pending = true;
+    dropped_late_rsp = false;
+
+    last_tag = tag_after(last_tag);
+    xact_tag = last_tag;
+    target_msg_tag = last_tag;
+    xact_outstanding = 1;
+
+    start_timeout(timeout);
+    return RETURN_CODE_SUCCESS;
+}
+
+void target_xact_add_request()
+{
+    ASSERT(ASSERT_TARGET_XACT_BUSY, xact_pending);
+
+    last_tag = tag_after(last_tag);
+    target_msg_tag = last_tag;
+    xact_outstanding++;
+}
+
+bool target_xact_pending()
+{
+    return xact_pending;
+}
+
+bool target_xact_complete(uartPkt_t *pkt)
+{
+    uint16_t sr;
+
+    if (pkt->seq != 0) {
+        if (!xact_pending || pkt->seq != xact_tag) {
+            LOG("target xact: stale rsp 0x%x tag %u\r\n", pkt->descriptor, pkt->seq);
+            return true; // consumed: response to an earlier request
+        }
+        if (pkt->descriptor != xact_rsp_descriptor)
+            return false;
+    } else {
+        if (late_rsps > 0 && pkt->descriptor == late_rsp_descriptor) {
+            LOG("target xact: late rsp 0x%x\r\n", pkt->descriptor);
+            late_rsps--;
+            dropped_late_rsp = true;
+            return true;
+        }
+        if (!xact_pending || pkt->descriptor != xact_rsp_descriptor)
+            return false;
+    }
+
+    xact_tag = tag_after(xact_tag);
+
+    sr = __get_SR_register();
+    __disable_interrupt(); // the timeout may fire meanwhile
+    stop_timeout();
+    if (--xact_outstanding > 0)
+        start_timeout(xact_timeout); // for the next response in the pipeline
+    __bis_SR_register(sr & GIE); // restore the caller's interrupt state
+
+    if (xact_outstanding > 0)
+        run_cb(pkt);
+    else
+        finish_xact(pkt);
+    return true;
+}
+
+void target_xact_expire()
+{
+    main_loop_flags &= ~FLAG_TARGET_XACT_TIMEOUT;
+
+    if (xact_pending) {
+        LOG("target xact: timeout: rsp 0x%x\r\n", xact_rsp_descriptor);
+
+        // If a response was dropped as late during this transaction, it was
+        // likely the response to this request, so do not expect another one:
+        // otherwise, a slow target would have every response dropped.
+        if (!dropped_late_rsp) {
+            late_rsp_descriptor = xact_rsp_descriptor;
+            late_rsps = xact_outstanding;
+        }
+
+        finish_xact(NULL);
+    }
+}
+
+#if defined(__TI_COMPILER_VERSION__) || defined(__IAR_SYSTEMS_ICC__)
+#pragma vector=TIMER_VECTOR(TIMER_XACT_TYPE, TIMER_XACT_IDX, TIMER_XACT_CCR)
+__interrupt void TIMER_ISR(TIMER_XACT_TYPE, TIMER_XACT_IDX, TIMER_XACT_CCR)(void)
+#elif defined(__GNUC__)
+__attribute__ ((interrupt(TIMER_VECTOR(TIMER_XACT_TYPE, TIMER_XACT_IDX, TIMER_XACT_CCR))))
+void TIMER_ISR(TIMER_XACT_TYPE, TIMER_XACT_IDX, TIMER_XACT_CCR)(void)
+#else
+#error Compiler not supported!
+#endif
+{
+    if (xact_timer_periods > 0) {
+        xact_timer_periods--; // matches again after a full timer period
+        return;
+    }
+
+    TIMER_CC(TIMER_XACT, TIMER_XACT_CCR, CCTL) &= ~CCIE;
+    main_loop_flags |= FLAG_TARGET_XACT_TIMEOUT;
+    __bic_SR_register_on_exit(LPM3_bits); // wakeup main loop
+}
@@ -0,0 +1,68 @@
+#ifndef TARGET_XACT_H
+#define TARGET_XACT_H
+
+#include <stdbool.h>
+
+#include "uart.h"
+#include "host_comm.h"
+
+/**
+ * @brief Completion callback of a request to the target
+ * @param rsp   Response from the target, or NULL if the request timed out
+ * @param arg   Value passed to target_xact_begin
+ * @details Called from the main loop, with host_msg_seq set to the value it
+ *          had when the transaction was started, so that replies to host
+ *          carry the sequence ID of the command that made the request.
+ */
+typedef void (target_xact_cb_t)(uartPkt_t *rsp, unsigned arg);
+
+/**
+ * @brief Set up the timer of transaction timeouts (at init)
+ */
+void target_xact_init();
+
+/**
+ * @brief Start a transaction: call before sending the request to the target
+ * @param rsp_descriptor    Descriptor of the expected response (WISP_RSP_*)
+ * @param timeout           Time to wait for the response (ms)
+ * @return RETURN_CODE_BUSY if a transaction is already pending (the target
+ *         handles one request at a time), in which case the request must
+ *         not be sent
+ * @details The request sent next is tagged (see target_msg_tag), and the
+ *          timeout runs on its own timer channel, not the sched timer.
+ */
+return_code_t target_xact_begin(unsigned rsp_descriptor, unsigned timeout,
+                                target_xact_cb_t *cb, unsigned arg);
+
+/**
+ * @brief Send another request in the pending transaction (pipelining)
+ * @details Call before sending the request. The target answers requests in
+ *          order: the callback runs for each response (the transaction is
+ *          still pending then, so it may add requests), and the timeout
+ *          restarts on each. The transaction completes with the response to
+ *          the last request, or on timeout (one callback with NULL, for all
+ *          requests not yet answered). The target must buffer as many
+ *          requests as are in flight.
+ */
+void target_xact_add_request();
+
+/**
+ * @brief Whether a request to the target is awaiting its response
+ */
+bool target_xact_pending();
+
+/**
+ * @brief Match a packet from the target to the pending transaction
+ * @return Whether the packet was consumed: the response (the callback was
+ *         run), or a late response to a request that timed out (dropped)
+ * @details Packets that are not responses (e.g. stdio) are left to the
+ *          caller.
+ */
+bool target_xact_complete(uartPkt_t *pkt);
+
+/**
+ * @brief Fail the pending transaction after FLAG_TARGET_XACT_TIMEOUT
+ */
+void target_xact_expire();
+
+#endif // TARGET_XACT_H
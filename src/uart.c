@@ -1,4 +1,6 @@
 #include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
 #include <msp430.h>
 
 #include <libmsp/periph.h>
@@ -11,34 +13,161 @@
 #include "error.h"
 #include "main_loop.h"
 #include "dma.h"
+#include "crc.h"
 
 #include "uart.h"
 
 // TODO: rename "usb" to "host"
 
 volatile unsigned host_uart_status = 0;
+volatile unsigned target_uart_status = 0;
+
+unsigned host_msg_seq = 0;
+unsigned target_msg_tag = 0;
+
+host_link_stats_t host_link_stats;
+
+#ifdef UART_HOST
+static unsigned host_link_flags = 0;
+
+// Size of the header of messages on the host link in the current session
+static inline unsigned host_header_len()
+{
+    return (host_link_flags & HOST_LINK_EXT_LEN) ?
+        UART_MSG_EXT_HEADER_SIZE : UART_MSG_HEADER_SIZE;
+}
+#endif // UART_HOST
+
+#ifdef CONFIG_HOST_UART_FRAMING
+
+// Bytes from the head of host RX ring already known not to be a delimiter
+static unsigned usbRx_scanned = 0;
+
+/**
+ * @brief Encoded frames for the host
+ * @details Space is allocated contiguously at the tail by the main loop
+ *          and released in FIFO order by the DMA ISR. The head is implied
+ *          by the tail and the number of bytes used, which includes the
+ *          space skipped at the end of the buffer when a frame did not fit.
+ */
+static uint8_t host_tx_frames[UART_HOST_TX_FRAME_BUF_SIZE];
+static unsigned host_tx_frames_tail = 0;
+static volatile unsigned host_tx_frames_used = 0;
+#endif // CONFIG_HOST_UART_FRAMING
 
 #ifdef UART_HOST
-static uartBuf_t usbRx = { .head = 0, .tail = 0 };
+static uint8_t usbRxStorage[UART_HOST_RX_RING_SIZE + UART_HOST_RX_SPILL_LEN];
+static uartBuf_t usbRx = { .buf = usbRxStorage, .mask = UART_HOST_RX_RING_SIZE - 1 };
+
+// Times the RX DMA channel wrapped around the ring (counted by the DMA ISR),
+// and bytes received up to the tail, both modulo the word size
+static volatile unsigned usbRx_wraps = 0;
+static unsigned usbRx_received = 0;
+
+// Set when the RX DMA overwrote bytes not yet released, cleared by the parser
+static bool usbRx_overrun = false;
 #endif // UART_HOST
 
 #ifdef UART_TARGET
-static uartBuf_t wispRx = { .head = 0, .tail = 0 };
-static uartBuf_t wispTx = { .head = 0, .tail = 0 };
+static uint8_t wispRxStorage[UART_TARGET_RX_RING_SIZE + UART_TARGET_RX_SPILL_LEN];
+static uartBuf_t wispRx = { .buf = wispRxStorage, .mask = UART_TARGET_RX_RING_SIZE - 1 };
+
+#ifndef DMA_TARGET_UART_TX
+// Rest of the message being sent to target by the TX ISR
+static const uint8_t *wispTx_msg;
+static unsigned wispTx_len;
+#endif
+
+// Target packets being forwarded to host straight out of the RX ring
+static volatile unsigned wispRx_forwarding = 0;
 #endif // UART_TARGET
 
+#ifdef UART_HOST
 /**
- * @brief       Determine the length of the circular buffer
- * @param       buf        Pointer to the circular buffer
- * @return      Length of the buffer
+ * @brief       Update the tail of the host RX ring from the DMA channel
+ * @details     The channel does repeated single transfers into the ring, so
+ *              the size register counts down the bytes left until the
+ *              channel wraps around to the start of the ring. Together with
+ *              the count of wraps, this gives the number of bytes received
+ *              since the last update: if they do not fit in the free space
+ *              of the ring, the DMA overwrote bytes still in use. Then the
+ *              unparsed bytes are dropped, and the parser resyncs on the
+ *              next message.
  */
-static inline unsigned uartBuf_len(uartBuf_t *buf) {
-    int diff = buf->tail - buf->head;
-    if(diff >= 0) {
-        return diff;
-    } else {
-        return (diff + UART_BUF_MAX_LEN_WITH_TAIL);
+static void usbRx_sync()
+{
+    unsigned size, wraps, received, held;
+    uint16_t sr = __get_SR_register();
+
+#ifdef CONFIG_ABORT_ON_HOST_UART_ERROR
+    // Best effort: the error flags are cleared when the DMA reads the byte
+    ASSERT(ASSERT_UART_FAULT, !(UART(UART_HOST, STAT) & UCRXERR));
+#endif
+
+    __disable_interrupt(); // DMA ISR counts the wraps
+    size = DMA(DMA_HOST_UART_RX, SZ);
+    wraps = usbRx_wraps;
+    // wrapped before the size was read, but the ISR has not run yet
+    if ((DMA(DMA_HOST_UART_RX, CTL) & DMAIFG) && size > UART_HOST_RX_RING_SIZE / 2)
+        wraps++;
+    __bis_SR_register(sr & GIE); // restore the caller's interrupt state
+
+    received = wraps * UART_HOST_RX_RING_SIZE + (UART_HOST_RX_RING_SIZE - size);
+
+    held = (usbRx.tail - usbRx.head) & usbRx.mask;
+    usbRx.tail = received & usbRx.mask;
+
+    if (held + (received - usbRx_received) > usbRx.mask) {
+        usbRx.parse = usbRx.tail;
+#ifdef CONFIG_HOST_UART_FRAMING
+        usbRx_scanned = 0;
+#endif
+        host_link_stats.rx_overruns++;
+        usbRx_overrun = true;
     }
+
+    usbRx_received = received;
+}
+
+void UART_host_rx_wrapped()
+{
+    usbRx_wraps++;
+}
+#endif // UART_HOST
+
+/**
+ * @brief       Determine the number of bytes not yet parsed into packets
+ */
+static inline unsigned uartBuf_unparsed(uartBuf_t *buf) {
+    return (buf->tail - buf->parse) & buf->mask;
+}
+
+/**
+ * @brief       Get a byte at an offset from the parse position of a circular buffer
+ */
+static inline uint8_t uartBuf_peek(uartBuf_t *buf, unsigned offset)
+{
+    return buf->buf[(buf->parse + offset) & buf->mask];
+}
+
+/**
+ * @brief       Get a contiguous view of bytes in a circular buffer
+ * @param       buf         Pointer to the circular buffer (with spill area)
+ * @param       offset      Offset of the first byte from the parse position
+ * @param       len         Number of bytes (at most the spill length of the ring)
+ * @return      Pointer to the bytes
+ * @details     If the bytes wrap around the end of the ring, the wrapped part
+ *              is copied into the spill area past the end of the ring.
+ */
+static uint8_t *uartBuf_view(uartBuf_t *buf, unsigned offset, unsigned len)
+{
+    unsigned start = (buf->parse + offset) & buf->mask;
+    unsigned until_end = buf->mask + 1 - start;
+
+    if (len > until_end)
+        memcpy(&buf->buf[buf->mask + 1], &buf->buf[0], len - until_end);
+
+    return &buf->buf[start];
 }
 
 void UART_setup(unsigned interface)
@@ -57,7 +186,7 @@ void UART_setup(unsigned interface)
 
         UART(UART_HOST, BR0) = CONFIG_USB_UART_BAUDRATE_BR0;
         UART(UART_HOST, BR1) = CONFIG_USB_UART_BAUDRATE_BR1;
-        UART(UART_HOST, MCTL) |= 0
+        UART(UART_HOST, MCTL) = 0
 #ifdef CONFIG_USB_UART_BAUDRATE_UCOS16
             | UCOS16
 #endif
@@ -72,9 +201,13 @@ void UART_setup(unsigned interface)
         // TX DMA
 
         DMA(DMA_HOST_UART_TX, CTL) &= ~DMAEN;
+        DMA(DMA_HOST_UART_RX, CTL) &= ~DMAEN;
 
+        // TX and RX channels share the trigger select register
         DMA_CTL(DMA_HOST_UART_TX_CTL) =
             DMA_TRIG(DMA_HOST_UART_TX, DMA_TRIG_UART(UART_HOST, TX));
+        DMA_CTL(DMA_HOST_UART_RX_CTL) |=
+            DMA_TRIG(DMA_HOST_UART_RX, DMA_TRIG_UART(UART_HOST, RX));
 
         DMACTL4 = DMARMWDIS;
 
@@ -87,8 +220,29 @@ void UART_setup(unsigned interface)
         DMA(DMA_HOST_UART_TX, DA) = (__DMA_ACCESS_REG__)(&UART(UART_HOST, TXBUF));
         // DMA(DMA_HOST_UART_TX, SZ) = set on each transfer
 
+        // RX DMA: repeated single transfers reload the address and size
+        // when the size reaches zero, so the hardware wraps the ring.
+        // The interrupt on each wrap is for overrun detection.
+        DMA(DMA_HOST_UART_RX, CTL) =
+              DMADT_4 /* repeated single */ |
+              DMADSTINCR_3 /* dest inc */ | DMASRCINCR_0 /* src no inc */ |
+              DMADSTBYTE | DMASRCBYTE | DMAIE;
+
+        DMA(DMA_HOST_UART_RX, SA) = (__DMA_ACCESS_REG__)(&UART(UART_HOST, RXBUF));
+        DMA(DMA_HOST_UART_RX, DA) = (__DMA_ACCESS_REG__)usbRxStorage;
+        DMA(DMA_HOST_UART_RX, SZ) = UART_HOST_RX_RING_SIZE;
+
+        usbRx.head = 0;
+        usbRx.parse = 0;
+        usbRx.tail = 0;
+        usbRx_wraps = 0;
+        usbRx_received = 0;
+        usbRx_overrun = false;
+
+        DMA(DMA_HOST_UART_RX, CTL) |= DMAEN;
+
         UART(UART_HOST, CTL1) &= ~UCSWRST; // initialize USCI state machine
-        UART(UART_HOST, IE) |= UCRXIE;     // enable Tx + Rx interrupts
+        // no RX interrupt: the RX flag triggers the DMA channel instead
         break;
 #endif // PORT_PORT_UART_USB
 
@@ -102,7 +256,7 @@ void UART_setup(unsigned interface)
 
         UART(UART_TARGET, BR0) = CONFIG_TARGET_UART_BAUDRATE_BR0;
         UART(UART_TARGET, BR1) = CONFIG_TARGET_UART_BAUDRATE_BR1;
-        UART(UART_TARGET, MCTL) |= 0
+        UART(UART_TARGET, MCTL) = 0
 #ifdef CONFIG_TARGET_UART_BAUDRATE_UCOS16
             | UCOS16
 #endif
@@ -114,8 +268,26 @@ void UART_setup(unsigned interface)
 #endif
        ;
 
+#ifdef DMA_TARGET_UART_TX
+        DMA(DMA_TARGET_UART_TX, CTL) &= ~DMAEN;
+
+        DMA_CTL(DMA_TARGET_UART_TX_CTL) |=
+            DMA_TRIG(DMA_TARGET_UART_TX, DMA_TRIG_UART(UART_TARGET, TX));
+
+        DMACTL4 = DMARMWDIS;
+
+        DMA(DMA_TARGET_UART_TX, CTL) =
+              DMADT_0 /* single */ |
+              DMADSTINCR_0 /* dest no inc */ | DMASRCINCR_3 /* src inc */ |
+              DMADSTBYTE | DMASRCBYTE | DMALEVEL | DMAIE;
+
+        // DMA(DMA_TARGET_UART_TX, SA) = set on each transfer
+        DMA(DMA_TARGET_UART_TX, DA) = (__DMA_ACCESS_REG__)(&UART(UART_TARGET, TXBUF));
+        // DMA(DMA_TARGET_UART_TX, SZ) = set on each transfer
+#endif // DMA_TARGET_UART_TX
+
         UART(UART_TARGET, CTL1) &= ~UCSWRST; // initialize USCI state machine
-        UART(UART_TARGET, IE) |= UCRXIE;     // enable Tx + Rx interrupts
+        UART(UART_TARGET, IE) |= UCRXIE;     // enable Rx interrupt (Tx is by DMA or enabled per message)
         break;
 
     default:
@@ -131,7 +303,7 @@ void UART_teardown(unsigned interface)
     {
 #ifdef UART_HOST
         case UART_INTERFACE_USB:
-            UART(UART_HOST, IE) &= ~UCRXIE;   // disable Tx + Rx interrupts
+            DMA(DMA_HOST_UART_RX, CTL) &= ~DMAEN;
             UART(UART_HOST, CTL1) |= UCSWRST; // put state machine in reset
             GPIO(PORT_UART_USB, SEL) &=
                 ~(BIT(PIN_UART_USB_TX) | BIT(PIN_UART_USB_RX));
@@ -141,7 +313,11 @@ void UART_teardown(unsigned interface)
 #endif // PORT_UART_USB
 #ifdef UART_TARGET
         case UART_INTERFACE_WISP:
-            UART(UART_TARGET, IE) &= ~UCRXIE;   // disable Tx + Rx interrupts
+            UART(UART_TARGET, IE) &= ~(UCRXIE | UCTXIE); // disable Tx + Rx interrupts
+#ifdef DMA_TARGET_UART_TX
+            DMA(DMA_TARGET_UART_TX, CTL) &= ~DMAEN;
+#endif
+            target_uart_status &= ~UART_STATUS_TX_BUSY; // abandon message in flight
             UART(UART_TARGET, CTL1) |= UCSWRST; // put state machine in reset
             GPIO(PORT_UART_TARGET, SEL) &=
                 ~(BIT(PIN_UART_TARGET_TX) | BIT(PIN_UART_TARGET_RX));
@@ -158,11 +334,12 @@ unsigned UART_RxBufEmpty(unsigned interface)
     {
 #ifdef UART_HOST
     case UART_INTERFACE_USB:
-        return usbRx.head == usbRx.tail;
+        usbRx_sync();
+        return usbRx.parse == usbRx.tail;
 #endif // PORT_UART_USB
 #ifdef UART_TARGET
     case UART_INTERFACE_WISP:
-        return wispRx.head == wispRx.tail;
+        return wispRx.parse == wispRx.tail;
 #endif
     default:
         return 0;
@@ -170,47 +347,227 @@ unsigned UART_RxBufEmpty(unsigned interface)
 }
 
 /**
- * @brief       Copy an array of bytes into a uartBuf_t circular buffer
- * @param       bufInto     Pointer to a uartBuf_t structure to which bytes will be copied
- * @param       bufFrom     Pointer to a byte array from which bytes will be copied
- * @param       len         Number of bytes to copy
- * @warning     This function does not check if there is enough space to copy the bytes.
- *              It will overwrite anything in its way.
+ * @brief       Advance the parse position
+ * @details     The bytes stay reserved until the head is moved past them.
+ */
+static inline void uartBuf_skip(uartBuf_t *buf, unsigned len)
+{
+    buf->parse = (buf->parse + len) & buf->mask;
+}
+
+#ifdef CONFIG_HOST_UART_FRAMING
+
+/**
+ * @brief   COBS encoder state, bytes are encoded one at a time
  */
-static void uartBuf_copyTo(uartBuf_t *bufInto, uint8_t *bufFrom, unsigned len)
+typedef struct {
+    uint8_t *dst;
+    unsigned len;       // bytes written to dst so far
+    unsigned code_idx;  // index of the code byte of the current block
+    uint8_t code;
+} cobs_encoder_t;
+
+static inline void cobs_begin(cobs_encoder_t *enc, uint8_t *dst)
 {
-    while(len--) {
-        ASSERT(ASSERT_UART_ERROR_CIRC_BUF_OVERFLOW, bufInto->tail < UART_BUF_MAX_LEN_WITH_TAIL);
-        bufInto->buf[bufInto->tail] = *bufFrom++; // copy byte
-        bufInto->tail = (bufInto->tail + sizeof(uint8_t)) % UART_BUF_MAX_LEN_WITH_TAIL;   // set tail of circular buffer
+    enc->dst = dst;
+    enc->code_idx = 0;
+    enc->len = 1;
+    enc->code = 1;
+}
+
+static inline void cobs_end_block(cobs_encoder_t *enc)
+{
+    enc->dst[enc->code_idx] = enc->code;
+    enc->code_idx = enc->len++;
+    enc->code = 1;
+}
+
+static inline void cobs_put(cobs_encoder_t *enc, uint8_t byte)
+{
+    if (byte == 0) {
+        cobs_end_block(enc);
+    } else {
+        enc->dst[enc->len++] = byte;
+        if (++enc->code == 0xFF)
+            cobs_end_block(enc);
     }
 }
 
+// Returns length including the delimiter
+static inline unsigned cobs_end(cobs_encoder_t *enc)
+{
+    enc->dst[enc->code_idx] = enc->code;
+    enc->dst[enc->len++] = 0; // delimiter
+    return enc->len;
+}
+
 /**
- * @brief       Copy bytes from a uartBuf_t circular buffer into an array of bytes
- * @param       bufFrom     Pointer to a uartBuf_t structure from which bytes will be copied
- * @param       bufInto     Pointer to a byte array to which bytes will be copied
- * @param       len         Number of bytes to copy
- * @warning     This function does not check if there is enough space to copy the bytes.
- *              It will overwrite anything in its way.
+ * @brief   Decode a COBS frame (without delimiter) in place
+ * @return  Length of decoded data, or zero if the encoding is invalid
  */
-static void uartBuf_copyFrom(uartBuf_t *bufFrom, uint8_t *bufInto, unsigned len)
+static unsigned cobs_decode(uint8_t *buf, unsigned len)
 {
-    while(len--) {
-        ASSERT(ASSERT_UART_ERROR_CIRC_BUF_OVERFLOW, bufFrom->head < UART_BUF_MAX_LEN_WITH_TAIL);
-        *bufInto++ = bufFrom->buf[bufFrom->head]; // copy byte
-        bufFrom->head = (bufFrom->head + sizeof(uint8_t)) % UART_BUF_MAX_LEN_WITH_TAIL;   // set head of circular buffer
+    unsigned in = 0, out = 0;
+    unsigned code, i;
+
+    while (in < len) {
+        code = buf[in++];
+        if (code == 0 || in + code - 1 > len)
+            return 0;
+        for (i = 1; i < code; ++i)
+            buf[out++] = buf[in++];
+        if (code < 0xFF && in < len)
+            buf[out++] = 0; // every block but the last ends at a zero
     }
+    return out;
+}
+
+/**
+ * @brief   Construct a packet from a COBS frame in the host RX ring
+ * @details The frame is decoded in place, so the packet is still a view
+ *          into the ring. A bad frame is dropped up to its delimiter, which
+ *          is where the next frame starts.
+ */
+static unsigned buildRxFrame(uartBuf_t *uartBuf, uartPkt_t *pkt)
+{
+    unsigned len = uartBuf_unparsed(uartBuf);
+    unsigned header_len = host_header_len();
+    unsigned frame_len, msg_len, data_len;
+    uint8_t *frame;
+    uint16_t crc;
+
+    for (frame_len = usbRx_scanned; frame_len < len; ++frame_len) {
+        if (uartBuf_peek(uartBuf, frame_len) == 0)
+            break;
+    }
+
+    if (frame_len == len) { // no delimiter yet
+        if (len < UART_HOST_RX_FRAME_MAX_LEN) {
+            usbRx_scanned = len;
+            return 2; // more data is needed
+        }
+        // too long to be a frame: skip it all and resync on next delimiter
+        uartBuf_skip(uartBuf, len);
+        usbRx_scanned = 0;
+        host_link_stats.resyncs++;
+        return 1;
+    }
+    usbRx_scanned = 0;
+
+    if (frame_len == 0) { // back-to-back delimiters are harmless
+        uartBuf_skip(uartBuf, 1);
+        return 1;
+    }
+
+    if (frame_len >= UART_HOST_RX_FRAME_MAX_LEN) {
+        uartBuf_skip(uartBuf, frame_len + 1);
+        host_link_stats.framing_errors++;
+        return 1;
+    }
+
+    frame = uartBuf_view(uartBuf, 0, frame_len);
+    msg_len = cobs_decode(frame, frame_len);
+
+    data_len = frame[2];
+    if (header_len == UART_MSG_EXT_HEADER_SIZE)
+        data_len |= frame[4] << 8;
+
+    if (msg_len < header_len + UART_FRAME_CRC_SIZE ||
+        frame[0] != UART_IDENTIFIER_USB ||
+        data_len != msg_len - header_len - UART_FRAME_CRC_SIZE) {
+        uartBuf_skip(uartBuf, frame_len + 1);
+        host_link_stats.framing_errors++;
+        return 1;
+    }
+
+    msg_len -= UART_FRAME_CRC_SIZE;
+    crc = crc16_update(CRC16_INIT, frame, msg_len);
+    if ((frame[msg_len] | (frame[msg_len + 1] << 8)) != crc) {
+        uartBuf_skip(uartBuf, frame_len + 1);
+        host_link_stats.crc_errors++;
+        return 1;
+    }
+
+    pkt->identifier = frame[0];
+    pkt->descriptor = frame[1];
+    pkt->length = data_len;
+    pkt->seq = frame[3];
+    pkt->data = &frame[header_len];
+    uartBuf_skip(uartBuf, frame_len + 1);
+    pkt->end = uartBuf->parse;
+    pkt->processed = 0;
+    host_link_stats.rx_msgs++;
+    return 0;
+}
+
+#endif // CONFIG_HOST_UART_FRAMING
+
+/**
+ * @brief       Parse the next packet at the parse position of an RX ring
+ * @return      Same as UART_buildRxPkt
+ */
+static unsigned parseRxPkt(unsigned interface, uartBuf_t *uartBuf, uartPkt_t *pkt)
+{
+    unsigned len; // the buffer length may change if bytes are received while
+                  // this function is executing, but there are at least this
+                  // many bytes
+    unsigned identifier, data_len;
+    unsigned header_len = UART_MSG_HEADER_SIZE;
+    unsigned max_len = UART_BUF_MAX_LEN;
+
+#ifdef UART_HOST
+    if (interface == UART_INTERFACE_USB) {
+#ifdef CONFIG_HOST_UART_FRAMING
+        if (host_link_flags & HOST_LINK_FRAMED)
+            return buildRxFrame(uartBuf, pkt);
+#endif
+        header_len = host_header_len();
+        max_len = UART_HOST_RX_MSG_MAX_LEN;
+    }
+#endif // UART_HOST
+
+    len = uartBuf_unparsed(uartBuf);
+    if (len < header_len)
+        return 2; // packet construction will resume the next time this function is called
+
+    identifier = uartBuf_peek(uartBuf, 0);
+    if(identifier != UART_IDENTIFIER_USB && identifier != UART_IDENTIFIER_WISP) {
+        // unknown identifier: skip the byte to resync on the next one
+        uartBuf_skip(uartBuf, 1);
+        if (interface == UART_INTERFACE_USB)
+            host_link_stats.resyncs++;
+        return 1;
+    }
+
+    data_len = uartBuf_peek(uartBuf, 2);
+    if (header_len == UART_MSG_EXT_HEADER_SIZE)
+        data_len |= uartBuf_peek(uartBuf, 4) << 8;
+
+    if (data_len > max_len - header_len) {
+        // drop the header
+        uartBuf_skip(uartBuf, header_len);
+        return 1;
+    }
+
+    if (len < header_len + data_len)
+        return 2; // not enough data
+
+    pkt->identifier = identifier;
+    pkt->descriptor = uartBuf_peek(uartBuf, 1);
+    pkt->length = data_len;
+    pkt->seq = uartBuf_peek(uartBuf, 3);
+    pkt->data = uartBuf_view(uartBuf, header_len, data_len);
+    uartBuf_skip(uartBuf, header_len + data_len);
+    pkt->end = uartBuf->parse;
+    pkt->processed = 0; // mark this packet as unprocessed
+    if (interface == UART_INTERFACE_USB)
+        host_link_stats.rx_msgs++;
+    return 0; // packet construction succeeded
 }
 
 unsigned UART_buildRxPkt(unsigned interface, uartPkt_t *pkt)
 {
-    static pktConstructState_t state = CONSTRUCT_STATE_IDENTIFIER;
     uartBuf_t *uartBuf;
-    unsigned minUartBufLen; // the buffer length may change if bytes are received while
-                           // this function is executing, but there are at least this
-                           // many bytes
-    uint8_t pkt_byte;
 
     if(!(pkt->processed)) {
         // don't overwrite the existing RX packet
@@ -222,6 +579,7 @@ unsigned UART_buildRxPkt(unsigned interface, uartPkt_t *pkt)
 #ifdef UART_HOST
     case UART_INTERFACE_USB:
         uartBuf = &usbRx;
+        usbRx_sync();
         break;
 #endif // PORT_UART_USB
 #ifdef UART_TARGET
@@ -231,193 +589,602 @@ unsigned UART_buildRxPkt(unsigned interface, uartPkt_t *pkt)
 #endif // PORT_UART_TARGET
     default:
         // unknown interface
-        state = CONSTRUCT_STATE_IDENTIFIER;
-        pkt->processed = 1;
         return 1;
     }
 
-    minUartBufLen = uartBuf_len(uartBuf);
-    while(minUartBufLen > 0) {
-        switch(state)
-        {
-        case CONSTRUCT_STATE_IDENTIFIER:
-            // copy identifier to packet structure
-            uartBuf_copyFrom(uartBuf, &pkt_byte, sizeof(uint8_t));
-            pkt->identifier = pkt_byte;
-            if(pkt->identifier != UART_IDENTIFIER_USB &&
-                                    pkt->identifier != UART_IDENTIFIER_WISP) {
-                // unknown identifier
-                pkt->processed = 1; // reset packet processed state
-                state = CONSTRUCT_STATE_IDENTIFIER;
-                return 1;
-            }
-            minUartBufLen -= sizeof(uint8_t);
-            state = CONSTRUCT_STATE_DESCRIPTOR;
-            break;
-        case CONSTRUCT_STATE_DESCRIPTOR:
-            // copy descriptor
-            uartBuf_copyFrom(uartBuf, &pkt_byte, sizeof(uint8_t));
-            pkt->descriptor = pkt_byte;
-            minUartBufLen -= sizeof(uint8_t);
-            state = CONSTRUCT_STATE_DATA_LEN;
-            break;
-        case CONSTRUCT_STATE_DATA_LEN:
-            uartBuf_copyFrom(uartBuf, &pkt_byte, sizeof(uint8_t));
-            pkt->length = pkt_byte;
-            minUartBufLen -= sizeof(uint8_t);
-            state = CONSTRUCT_STATE_PADDING;
-            break;
-        case CONSTRUCT_STATE_PADDING:
-        {
-            uartBuf_copyFrom(uartBuf, &pkt_byte, sizeof(uint8_t));
-            minUartBufLen -= sizeof(uint8_t);
-            if (pkt->length > 0) {
-                state = CONSTRUCT_STATE_DATA;
-            } else { // done
-                pkt->processed = 0;
-                state = CONSTRUCT_STATE_IDENTIFIER;
-                return 0;   // packet construction succeeded
-            }
+    // the previous (processed) packet was the only one holding ring space,
+    // unless packets are still being forwarded out of the target ring
+#ifdef UART_TARGET
+    if (uartBuf != &wispRx || !wispRx_forwarding)
+#endif
+        uartBuf->head = uartBuf->parse;
+
+    return parseRxPkt(interface, uartBuf, pkt);
+}
+
+#ifdef UART_HOST
+/**
+ * @brief Queue of commands parsed from the host RX ring
+ * @details Slots are in arrival order starting at host_cmds_first. The
+ *          first host_cmds_issued of them have been handed out for
+ *          execution. Ring space is released in order, once the oldest
+ *          packets are marked as processed.
+ */
+static uartPkt_t host_cmds[UART_HOST_CMD_QUEUE_LEN];
+static unsigned host_cmds_first = 0;
+static unsigned host_cmds_count = 0;
+static unsigned host_cmds_issued = 0;
+
+uartPkt_t *UART_peek_host_cmd()
+{
+    uartPkt_t *pkt;
+    unsigned rc;
+
+    // release ring space of the oldest processed commands
+    while (host_cmds_issued > 0 && host_cmds[host_cmds_first].processed) {
+        usbRx.head = host_cmds[host_cmds_first].end;
+        host_cmds_first = (host_cmds_first + 1) & (UART_HOST_CMD_QUEUE_LEN - 1);
+        host_cmds_count--;
+        host_cmds_issued--;
+    }
+    if (host_cmds_count == 0)
+        usbRx.head = usbRx.parse; // also release bytes dropped by the parser
+
+    usbRx_sync();
+    if (usbRx_overrun) {
+        // commands not yet issued may have been overwritten: drop them
+        usbRx_overrun = false;
+        host_cmds_count = host_cmds_issued;
+        if (host_cmds_count == 0)
+            usbRx.head = usbRx.parse;
+    }
+
+    // parse ahead into free slots
+    while (host_cmds_count < UART_HOST_CMD_QUEUE_LEN) {
+        pkt = &host_cmds[(host_cmds_first + host_cmds_count) & (UART_HOST_CMD_QUEUE_LEN - 1)];
+        rc = parseRxPkt(UART_INTERFACE_USB, &usbRx, pkt);
+        if (rc == 0)
+            host_cmds_count++;
+        else if (rc == 2)
             break;
-        }
-        case CONSTRUCT_STATE_DATA:
-            if(minUartBufLen >= pkt->length) {
-                // copy the data
-                if (pkt->length > UART_PKT_MAX_DATA_LEN) {
-                    pkt->processed = 1; // reset packet processed state
-                    state = CONSTRUCT_STATE_IDENTIFIER;
-                    return 1;
-                }
-                uartBuf_copyFrom(uartBuf, pkt->data, pkt->length);
-                // no need to update the minUartBufLen, since packet construction is complete
-                // mark this packet as unprocessed
-				pkt->processed = 0;
-                state = CONSTRUCT_STATE_IDENTIFIER;
-                return 0; // packet construction succeeded
-            } else {
-                // not enough data
-                return 2; // packet construction will resume the next time this function is called
-            }
-        default:
-            // unknown state, so reset the packet construction state
-            pkt->processed = 1;
-            state = CONSTRUCT_STATE_IDENTIFIER;
-            return 1;       // packet construction failed
-        }
     }
 
-    // ran out of data
-    return 2;   // packet construction will resume the next time this function is called
+    if (host_cmds_issued == host_cmds_count)
+        return NULL;
+
+    return &host_cmds[(host_cmds_first + host_cmds_issued) & (UART_HOST_CMD_QUEUE_LEN - 1)];
 }
 
+uartPkt_t *UART_next_host_cmd()
+{
+    uartPkt_t *pkt = UART_peek_host_cmd();
+
+    if (pkt)
+        host_cmds_issued++;
+    return pkt;
+}
+#endif // UART_HOST
+
 static inline unsigned write_header(uint8_t *buf,
                                     unsigned identifier, unsigned descriptor,
-                                    unsigned payload_len)
+                                    unsigned payload_len, unsigned tag)
 {
     unsigned len = 0;
 
     buf[len++] = identifier;
     buf[len++] = descriptor;
     buf[len++] = payload_len;
-    buf[len++] = 0; // padding
+    buf[len++] = tag;
 
     len += payload_len;
 
     return len;
 }
 
-// TODO: make target version also copy-free
+#ifdef UART_HOST
+/**
+ * @brief   Write the header of a message to host
+ * @return  Length of the header (depends on the header variant in use)
+ */
+static inline unsigned write_host_header(uint8_t *header, unsigned descriptor,
+                                         unsigned payload_len)
+{
+    unsigned header_len = host_header_len();
+
+    header[0] = UART_IDENTIFIER_USB;
+    header[1] = descriptor;
+    header[2] = payload_len & 0xff;
+    header[3] = host_msg_seq;
+    if (header_len == UART_MSG_EXT_HEADER_SIZE) {
+        header[4] = payload_len >> 8;
+        header[5] = 0; // padding
+    }
+
+    return header_len;
+}
+#endif // UART_HOST
+
 void UART_send_msg_to_target(unsigned descriptor, unsigned payload_len, uint8_t *buf)
 {
     unsigned len;
-    unsigned uartBufLen, copyLen;
-    uint8_t *byte_ptr;
 
     LOG("send tgt: desc 0x%x len %u\r\n", descriptor, payload_len);
 
-    len = write_header(buf, UART_IDENTIFIER_WISP, descriptor, payload_len);
+    // one message in flight at a time: the header is written into buf
+    while (target_uart_status & UART_STATUS_TX_BUSY);
 
-	// loop until we have copied all of buf into the UART TX buffer
-    byte_ptr = buf;
-	while(len > 0) {
-		uartBufLen = uartBuf_len(&wispTx);
-		copyLen = MIN(UART_BUF_MAX_LEN - uartBufLen, len);
-		uartBuf_copyTo(&wispTx, byte_ptr, copyLen);
-		byte_ptr += copyLen;
-		len -= copyLen;
-	}
+    len = write_header(buf, UART_IDENTIFIER_WISP, descriptor, payload_len,
+                       target_msg_tag);
+    target_msg_tag = 0; // only the request that starts the transaction
+
+    target_uart_status |= UART_STATUS_TX_BUSY;
+
+#ifdef DMA_TARGET_UART_TX
+    DMA(DMA_TARGET_UART_TX, SA) = (__DMA_ACCESS_REG__)buf;
+    DMA(DMA_TARGET_UART_TX, SZ) = len;
+
+    DMA(DMA_TARGET_UART_TX, CTL) |= DMAEN;
+#else // !DMA_TARGET_UART_TX
+    wispTx_msg = buf;
+    wispTx_len = len;
 
     // enable the correct interrupt to start sending data
     UART(UART_TARGET, IE) |= UCTXIE;
+#endif // !DMA_TARGET_UART_TX
 
     LOG("sent tgt: desc 0x%x len %u\r\n", descriptor, payload_len);
 }
 
+void UART_target_tx_complete()
+{
+    target_uart_status &= ~UART_STATUS_TX_BUSY;
+    main_loop_flags |= FLAG_UART_WISP_TX;
+}
+
 #ifdef UART_HOST
 
-void UART_send_msg_to_host(unsigned descriptor, unsigned payload_len, uint8_t *buf)
-{
+/**
+ * @brief   Queue of DMA descriptors for messages to host
+ * @details The descriptor at the head is on the wire while the TX busy
+ *          status is set. Enqueued by main loop, dequeued by the DMA ISR.
+ */
+typedef struct {
+    const uint8_t *msg; // start of the transfer
     unsigned len;
+    uart_tx_complete_t *on_complete; // set on the last segment of a message
+    uint8_t *buf; // passed to on_complete
+#ifdef CONFIG_HOST_UART_FRAMING
+    unsigned frame_charge; // bytes to release from the frame buffer
+#endif
+} host_tx_desc_t;
 
-    while (host_uart_status & UART_STATUS_TX_BUSY);
-    host_uart_status |= UART_STATUS_TX_BUSY;
+static host_tx_desc_t host_tx_queue[UART_HOST_TX_QUEUE_LEN];
+static volatile unsigned host_tx_head = 0;
+static volatile unsigned host_tx_tail = 0;
+
+// Message headers, in the slot of the descriptor that transfers them
+static uint8_t host_tx_headers[UART_HOST_TX_QUEUE_LEN][UART_MSG_EXT_HEADER_SIZE];
 
-    DMA(DMA_HOST_UART_TX, CTL) &= ~DMAEN; // should already be disabled, but just in case
+#define HOST_TX_NEXT(idx) (((idx) + 1) & (UART_HOST_TX_QUEUE_LEN - 1))
 
-    len = write_header(buf, UART_IDENTIFIER_USB, descriptor, payload_len);
+static inline void host_tx_start(host_tx_desc_t *desc)
+{
+    host_uart_status |= UART_STATUS_TX_BUSY;
 
-    DMA(DMA_HOST_UART_TX, SA) = (__DMA_ACCESS_REG__)buf;
-    DMA(DMA_HOST_UART_TX, SZ) = len;
+    DMA(DMA_HOST_UART_TX, SA) = (__DMA_ACCESS_REG__)desc->msg;
+    DMA(DMA_HOST_UART_TX, SZ) = desc->len;
 
     DMA(DMA_HOST_UART_TX, CTL) |= DMAEN;
 }
 
-static inline void UART_wait_for_tx_dma()
+/**
+ * @brief   Wait for descriptors to be free at the tail of the queue
+ * @return  Index of the first of the descriptors
+ */
+static unsigned host_tx_reserve(unsigned count)
+{
+    // one slot is kept free to tell a full queue from an empty one
+    while (((host_tx_head - host_tx_tail - 1) & (UART_HOST_TX_QUEUE_LEN - 1)) < count);
+    return host_tx_tail;
+}
+
+static inline void host_tx_set(unsigned idx, const uint8_t *msg, unsigned len)
+{
+    host_tx_desc_t *desc = &host_tx_queue[idx];
+
+    desc->msg = msg;
+    desc->len = len;
+    desc->on_complete = NULL;
+#ifdef CONFIG_HOST_UART_FRAMING
+    desc->frame_charge = 0;
+#endif
+}
+
+/**
+ * @brief   Hand the descriptors from the tail up to new_tail to the DMA ISR
+ * @details The frame buffer space charged to the descriptors is accounted
+ *          as used here, and released by the DMA ISR as each one completes.
+ */
+static void host_tx_commit(unsigned new_tail)
+{
+    unsigned first;
+    uint16_t sr = __get_SR_register();
+#ifdef CONFIG_HOST_UART_FRAMING
+    unsigned idx, frame_charge = 0;
+
+    for (idx = host_tx_tail; idx != new_tail; idx = HOST_TX_NEXT(idx))
+        frame_charge += host_tx_queue[idx].frame_charge;
+#endif
+
+    __disable_interrupt(); // DMA ISR dequeues and starts descriptors
+#ifdef CONFIG_HOST_UART_FRAMING
+    host_tx_frames_used += frame_charge;
+#endif
+    first = host_tx_tail;
+    host_tx_tail = new_tail;
+    if (!(host_uart_status & UART_STATUS_TX_BUSY))
+        host_tx_start(&host_tx_queue[first]); // queue was empty, so first is the head
+    __bis_SR_register(sr & GIE); // restore the caller's interrupt state
+}
+
+#ifdef CONFIG_HOST_UART_FRAMING
+/**
+ * @brief   Encode a message with a CRC into the frame buffer and queue it
+ */
+static void send_frame_to_host(const uint8_t *header, unsigned header_len,
+                               const uart_segment_t *segments, unsigned count)
+{
+    unsigned len = header_len;
+    unsigned max_len;
+    unsigned until_end, skipped, offset;
+    unsigned frame_len, i, j;
+    unsigned idx;
+    cobs_encoder_t enc;
+    uint16_t crc;
+
+    for (i = 0; i < count; ++i)
+        len += segments[i].len;
+    max_len = UART_FRAME_ENCODED_LEN(len);
+
+    ASSERT(ASSERT_HOST_MSG_BUF_OVERFLOW, max_len <= UART_HOST_TX_FRAME_BUF_SIZE);
+
+    // wait for enough contiguous space to be released by the DMA ISR
+    do {
+        if (host_tx_frames_used == 0)
+            host_tx_frames_tail = 0; // all released: restart from the beginning
+
+        until_end = UART_HOST_TX_FRAME_BUF_SIZE - host_tx_frames_tail;
+        skipped = until_end < max_len ? until_end : 0; // wrap
+        offset = skipped ? 0 : host_tx_frames_tail;
+    } while (UART_HOST_TX_FRAME_BUF_SIZE - host_tx_frames_used < skipped + max_len);
+
+    cobs_begin(&enc, &host_tx_frames[offset]);
+
+    crc = crc16_update(CRC16_INIT, header, header_len);
+    for (j = 0; j < header_len; ++j)
+        cobs_put(&enc, header[j]);
+    for (i = 0; i < count; ++i) {
+        crc = crc16_update(crc, segments[i].buf, segments[i].len);
+        for (j = 0; j < segments[i].len; ++j)
+            cobs_put(&enc, segments[i].buf[j]);
+    }
+    cobs_put(&enc, crc & 0xff);
+    cobs_put(&enc, crc >> 8);
+    frame_len = cobs_end(&enc);
+
+    host_tx_frames_tail = offset + frame_len;
+
+    idx = host_tx_reserve(1);
+    host_tx_set(idx, &host_tx_frames[offset], frame_len);
+    host_tx_queue[idx].frame_charge = skipped + frame_len; // incl. space skipped to wrap
+    host_tx_commit(HOST_TX_NEXT(idx));
+}
+
+#endif // CONFIG_HOST_UART_FRAMING
+
+void UART_set_host_link(unsigned flags)
+{
+    host_link_flags = flags;
+#ifdef CONFIG_HOST_UART_FRAMING
+    usbRx_scanned = 0;
+#endif
+    memset(&host_link_stats, 0, sizeof(host_link_stats));
+}
+
+#if defined(CONFIG_HOST_UART_BAUDRATE_NEGOTIATION) || \
+    defined(CONFIG_TARGET_UART_BAUDRATE_NEGOTIATION)
+/**
+ * @brief   Compute the divisor settings for a UART baudrate
+ * @param   oversample  Whether the link is configured with UCOS16
+ * @return  0 on success, 1 if the rate is out of range or too inaccurate
+ * @details Same computation as CONFIG_*_UART_BAUDRATE_BR* in uart.h. A link
+ *          configured with oversampling falls back to the low-frequency
+ *          mode for rates above a 16th of the clock.
+ */
+static unsigned uart_divisor(uint32_t baud, bool oversample,
+                             uint16_t *br, uint8_t *mctl)
+{
+    uint32_t clk = CONFIG_UART_CLOCK_FREQ;
+    uint32_t scale, div, err;
+
+    if (baud == 0 || baud > clk)
+        return 1;
+
+    scale = (oversample && clk / 16 >= baud) ? 1 : 8;
+    div = (clk * scale + baud / 2) / baud;
+    err = UART_ABS_DIFF(div * baud, clk * scale);
+
+    if ((uint64_t)err * 1000000 / (clk * scale) > CONFIG_UART_MAX_BAUD_ERROR_PPM)
+        return 1;
+
+    if (scale == 1) {
+        *br = div / 16;
+        *mctl = UCOS16 | BRF_BITS(div % 16);
+    } else {
+        *br = div / 8;
+        *mctl = BRS_BITS(div % 8);
+    }
+    return *br == 0;
+}
+#endif // CONFIG_HOST_UART_BAUDRATE_NEGOTIATION || CONFIG_TARGET_UART_BAUDRATE_NEGOTIATION
+
+#ifdef CONFIG_HOST_UART_BAUDRATE_NEGOTIATION
+#ifdef CONFIG_USB_UART_BAUDRATE_UCOS16
+#define HOST_UART_OVERSAMPLE true
+#else
+#define HOST_UART_OVERSAMPLE false
+#endif
+
+// Divisor settings of the host UART before the last rate switch
+static uint16_t host_uart_prev_br;
+static uint8_t host_uart_prev_mctl;
+
+static void host_uart_set_divisor(uint16_t br, uint8_t mctl)
+{
+    // let queued messages go out at the old rate
+    while (host_uart_status & UART_STATUS_TX_BUSY);
+    while (UART(UART_HOST, STAT) & UCBUSY);
+
+    UART(UART_HOST, CTL1) |= UCSWRST;
+    UART(UART_HOST, BR0) = br & 0xff;
+    UART(UART_HOST, BR1) = br >> 8;
+    UART(UART_HOST, MCTL) = mctl;
+    UART(UART_HOST, CTL1) &= ~UCSWRST;
+}
+
+unsigned UART_check_host_baudrate(uint32_t baud)
+{
+    uint16_t br;
+    uint8_t mctl;
+
+    return uart_divisor(baud, HOST_UART_OVERSAMPLE, &br, &mctl);
+}
+
+unsigned UART_set_host_baudrate(uint32_t baud)
+{
+    uint16_t br;
+    uint8_t mctl;
+
+    if (uart_divisor(baud, HOST_UART_OVERSAMPLE, &br, &mctl))
+        return 1;
+
+    host_uart_prev_br = UART(UART_HOST, BR0) | (UART(UART_HOST, BR1) << 8);
+    host_uart_prev_mctl = UART(UART_HOST, MCTL);
+
+    host_uart_set_divisor(br, mctl);
+    return 0;
+}
+
+void UART_revert_host_baudrate()
+{
+    host_uart_set_divisor(host_uart_prev_br, host_uart_prev_mctl);
+}
+#endif // CONFIG_HOST_UART_BAUDRATE_NEGOTIATION
+
+#ifdef CONFIG_TARGET_UART_BAUDRATE_NEGOTIATION
+#ifdef CONFIG_TARGET_UART_BAUDRATE_UCOS16
+#define TARGET_UART_OVERSAMPLE true
+#else
+#define TARGET_UART_OVERSAMPLE false
+#endif
+
+// Divisor settings of the target UART before the last rate switch
+static uint16_t target_uart_prev_br;
+static uint8_t target_uart_prev_mctl;
+
+static void target_uart_set_divisor(uint16_t br, uint8_t mctl)
+{
+    // let the message in flight go out at the old rate
+    while (target_uart_status & UART_STATUS_TX_BUSY);
+    while (UART(UART_TARGET, STAT) & UCBUSY);
+
+    UART(UART_TARGET, CTL1) |= UCSWRST;
+    UART(UART_TARGET, BR0) = br & 0xff;
+    UART(UART_TARGET, BR1) = br >> 8;
+    UART(UART_TARGET, MCTL) = mctl;
+    UART(UART_TARGET, CTL1) &= ~UCSWRST;
+    UART(UART_TARGET, IE) |= UCRXIE; // reset clears the interrupt enables
+}
+
+unsigned UART_check_target_baudrate(uint32_t baud)
+{
+    uint16_t br;
+    uint8_t mctl;
+
+    if (baud > CONFIG_TARGET_UART_MAX_BAUDRATE)
+        return 1;
+    return uart_divisor(baud, TARGET_UART_OVERSAMPLE, &br, &mctl);
+}
+
+unsigned UART_set_target_baudrate(uint32_t baud)
+{
+    uint16_t br;
+    uint8_t mctl;
+
+    if (baud > CONFIG_TARGET_UART_MAX_BAUDRATE ||
+        uart_divisor(baud, TARGET_UART_OVERSAMPLE, &br, &mctl))
+        return 1;
+
+    target_uart_prev_br = UART(UART_TARGET, BR0) | (UART(UART_TARGET, BR1) << 8);
+    target_uart_prev_mctl = UART(UART_TARGET, MCTL);
+
+    target_uart_set_divisor(br, mctl);
+    return 0;
+}
+
+void UART_revert_target_baudrate()
 {
-    while (host_uart_status & UART_STATUS_TX_BUSY) {
-        __delay_cycles(10);
+    target_uart_set_divisor(target_uart_prev_br, target_uart_prev_mctl);
+}
+#endif // CONFIG_TARGET_UART_BAUDRATE_NEGOTIATION
+
+void UART_send_segments_to_host(unsigned descriptor,
+                                const uart_segment_t *segments, unsigned count,
+                                uart_tx_complete_t *on_complete)
+{
+    unsigned payload_len = 0;
+    unsigned idx, last, i;
+    uint8_t *header;
+
+    for (i = 0; i < count; ++i)
+        payload_len += segments[i].len;
+
+#ifdef CONFIG_HOST_UART_FRAMING
+    if (host_link_flags & HOST_LINK_FRAMED) {
+        uint8_t frame_header[UART_MSG_EXT_HEADER_SIZE];
+        unsigned header_len = write_host_header(frame_header, descriptor, payload_len);
+
+        send_frame_to_host(frame_header, header_len, segments, count);
+
+        // the message was copied into the frame, so the segments are free already
+        if (on_complete)
+            on_complete(count ? (uint8_t *)segments[0].buf : NULL);
+        return;
+    }
+#endif // CONFIG_HOST_UART_FRAMING
+
+    // one DMA transfer for the header and one for each segment
+    ASSERT(ASSERT_HOST_MSG_BUF_OVERFLOW, count + 1 < UART_HOST_TX_QUEUE_LEN);
+
+    idx = host_tx_reserve(count + 1);
+
+    header = &host_tx_headers[idx][0];
+    host_tx_set(idx, header, write_host_header(header, descriptor, payload_len));
+
+    last = idx;
+    for (i = 0; i < count; ++i) {
+        if (segments[i].len == 0)
+            continue;
+        last = HOST_TX_NEXT(last);
+        host_tx_set(last, segments[i].buf, segments[i].len);
     }
+
+    host_tx_queue[last].on_complete = on_complete;
+    host_tx_queue[last].buf = count ? (uint8_t *)segments[0].buf : NULL;
+
+    host_tx_commit(HOST_TX_NEXT(last));
 }
 
-void UART_begin_transmission()
+void UART_send_msg_to_host(unsigned descriptor, unsigned payload_len, uint8_t *buf,
+                           uart_tx_complete_t *on_complete)
 {
-    UART_wait_for_tx_dma();
+    uart_segment_t segment = { .buf = buf, .len = payload_len };
+
+    UART_send_segments_to_host(descriptor, &segment, 1, on_complete);
 }
 
-void UART_end_transmission()
+unsigned UART_host_max_payload_len()
 {
-    UART_wait_for_tx_dma();
+    unsigned max_len = (host_link_flags & HOST_LINK_EXT_LEN) ? 0xffff : 0xff;
+
+#ifdef CONFIG_HOST_UART_FRAMING
+    // the whole encoded frame must fit in the frame buffer
+    if ((host_link_flags & HOST_LINK_FRAMED) &&
+        max_len > UART_HOST_TX_FRAME_MAX_PAYLOAD_LEN)
+        max_len = UART_HOST_TX_FRAME_MAX_PAYLOAD_LEN;
+#endif
+
+    return max_len;
+}
+
+void UART_host_tx_complete()
+{
+    host_tx_desc_t *desc = &host_tx_queue[host_tx_head];
+    unsigned head = HOST_TX_NEXT(host_tx_head);
+
+    host_tx_head = head;
+    if (head != host_tx_tail)
+        host_tx_start(&host_tx_queue[head]);
+    else
+        host_uart_status &= ~UART_STATUS_TX_BUSY;
+
+#ifdef CONFIG_HOST_UART_FRAMING
+    host_tx_frames_used -= desc->frame_charge;
+#endif
+
+    // the slot is not reused before the main loop runs again
+    if (desc->on_complete)
+        desc->on_complete(desc->buf);
 }
 
 #endif // UART_HOST
 
+#if defined(UART_HOST) && defined(UART_TARGET)
+
+static void on_target_pkt_forwarded(uint8_t *buf)
+{
+    // Transfers complete in order, so the packets after this one are still
+    // at or past its data.
+    wispRx.head = buf - &wispRx.buf[0];
+    wispRx_forwarding--;
+}
+
+void UART_forward_target_pkt(unsigned descriptor, uartPkt_t *pkt)
+{
+    uint16_t sr = __get_SR_register();
+
+    // the ring space is held from the start of this packet (where
+    // UART_buildRxPkt left the head) until the transfer completes
+    __disable_interrupt(); // DMA ISR releases forwarded packets
+    wispRx_forwarding++;
+    __bis_SR_register(sr & GIE); // restore the caller's interrupt state
+
+    UART_send_msg_to_host(descriptor, pkt->length, pkt->data, on_target_pkt_forwarded);
+}
+
+#endif // UART_HOST && UART_TARGET
+
 static inline void on_rx_int(uint8_t data, uartBuf_t *rxbuf, unsigned flag)
 {
+    unsigned tail = (rxbuf->tail + 1) & rxbuf->mask;
+
+    // Ring full: drop the byte rather than overwrite a packet that is still
+    // in use. The parser resyncs on the next packet identifier.
+    if (tail == rxbuf->head)
+        return;
+
     rxbuf->buf[rxbuf->tail] = data; // copy the new byte
 
     // update circular buffer tail
-    rxbuf->tail = (rxbuf->tail + sizeof(uint8_t)) % UART_BUF_MAX_LEN_WITH_TAIL;
+    rxbuf->tail = tail;
 
     main_loop_flags |= flag;
 }
 
-static inline void on_tx_int(volatile uint8_t *datareg, volatile uint8_t *intreg,
-                             uartBuf_t *txbuf, unsigned flag)
+#if defined(UART_TARGET) && !defined(DMA_TARGET_UART_TX)
+static inline void on_target_tx_int()
 {
-    *datareg = txbuf->buf[txbuf->head];
-
-    // update circular buffer headd
-    txbuf->head = (txbuf->head + sizeof(uint8_t)) % UART_BUF_MAX_LEN_WITH_TAIL;
-
-    main_loop_flags |= flag;
+    UART(UART_TARGET, TXBUF) = *wispTx_msg++;
 
-    if (txbuf->head == txbuf->tail) {
-        // the software buffer is empty
-        *intreg &= ~UCTXIE; // disable TX interrupt
+    if (--wispTx_len == 0) {
+        UART(UART_TARGET, IE) &= ~UCTXIE; // disable TX interrupt
+        UART_target_tx_complete();
     }
 }
+#endif // UART_TARGET && !DMA_TARGET_UART_TX
 
-#if (defined(UART_HOST) && UART_HOST == 0) || (defined(UART_TARGET) && UART_TARGET == 0)
+// Host RX is serviced by DMA, so only the target UART uses the ISR
+#if defined(UART_TARGET) && UART_TARGET == 0
 
 #if defined(__TI_COMPILER_VERSION__) || defined(__IAR_SYSTEMS_ICC__)
 #pragma vector=USCI_A0_VECTOR
@@ -434,14 +1201,7 @@ void __attribute__ ((interrupt(USCI_A0_VECTOR))) USCI_A0_ISR (void)
 
     case USCI_UCRXIFG:                      // Vector 2 - RXIFG
     {
-#if defined(UART_HOST) && UART_HOST == 0
-
-#ifdef CONFIG_ABORT_ON_HOST_UART_ERROR
-        ASSERT(ASSERT_UART_FAULT,  !(UCA0STAT & UCRXERR));
-#endif
-
-        on_rx_int(UART(UART_HOST, RXBUF), &usbRx, FLAG_UART_USB_RX);
-#elif defined(UART_TARGET) && UART_TARGET == 0
+#if defined(UART_TARGET) && UART_TARGET == 0
         on_rx_int(UART(UART_TARGET, RXBUF), &wispRx, FLAG_UART_WISP_RX);
 #endif
         break;
@@ -449,9 +1209,8 @@ void __attribute__ ((interrupt(USCI_A0_VECTOR))) USCI_A0_ISR (void)
 
     case USCI_UCTXIFG:                        // Vector 4 - TXIFG
     {
-#if defined(UART_TARGET) && UART_TARGET == 0
-        on_tx_int(&UART(UART_TARGET, TXBUF), &UART(UART_TARGET, IE),
-                  &wispTx, FLAG_UART_WISP_TX);
+#if defined(UART_TARGET) && UART_TARGET == 0 && !defined(DMA_TARGET_UART_TX)
+        on_target_tx_int();
 #endif
         break;
     }
@@ -462,7 +1221,7 @@ void __attribute__ ((interrupt(USCI_A0_VECTOR))) USCI_A0_ISR (void)
 }
 #endif // UART A0 users
 
-#if (defined(UART_HOST) && UART_HOST == 1) || (defined(UART_TARGET) && UART_TARGET == 1)
+#if defined(UART_TARGET) && UART_TARGET == 1
 
 #if defined(__TI_COMPILER_VERSION__) || defined(__IAR_SYSTEMS_ICC__)
 #pragma vector=USCI_A1_VECTOR
@@ -479,14 +1238,7 @@ void __attribute__ ((interrupt(USCI_A1_VECTOR))) USCI_A1_ISR (void)
 
     case USCI_UCRXIFG:                        // Vector 2 - RXIFG
     {
-#if defined(UART_HOST) && UART_HOST == 1
-
-#ifdef CONFIG_ABORT_ON_HOST_UART_ERROR
-        ASSERT(ASSERT_UART_FAULT,  !(UCA1STAT & UCRXERR));
-#endif
-
-        on_rx_int(UART(UART_HOST, RXBUF), &usbRx, FLAG_UART_USB_RX);
-#elif defined(UART_TARGET) && UART_TARGET == 1
+#if defined(UART_TARGET) && UART_TARGET == 1
         on_rx_int(UART(UART_TARGET, RXBUF), &wispRx, FLAG_UART_WISP_RX);
 #endif
         break;
@@ -494,9 +1246,8 @@ void __attribute__ ((interrupt(USCI_A1_VECTOR))) USCI_A1_ISR (void)
 
     case USCI_UCTXIFG:                        // Vector 4 - TXIFG
     {
-#if defined(UART_TARGET) && UART_TARGET == 1
-        on_tx_int(&UART(UART_TARGET, TXBUF), &UART(UART_TARGET, IE),
-                  &wispTx, FLAG_UART_WISP_TX);
+#if defined(UART_TARGET) && UART_TARGET == 1 && !defined(DMA_TARGET_UART_TX)
+        on_target_tx_int();
 #endif
         break;
     }
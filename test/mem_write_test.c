@@ -0,0 +1,251 @@
+/**
+ * @file
+ * @brief Host build tests of the pipelined bulk write of target memory
+ * @details The target is simulated: requests are queued as they are sent,
+ *          and answered in order by the test, through target_xact_complete.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "target_xact.c"
+#include "mem_write.c"
+
+#define TARGET_MEM_SIZE     1024
+#define MAX_REQS            64
+
+volatile uint16_t main_loop_flags;
+unsigned host_msg_seq;
+unsigned target_msg_tag;
+
+static unsigned failures = 0;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%u: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+typedef struct {
+    bool write;
+    uint32_t address;
+    unsigned len;
+    unsigned tag;
+} req_t;
+
+static uint8_t target_mem[TARGET_MEM_SIZE];
+static req_t reqs[MAX_REQS]; // sent, not yet answered
+static unsigned reqs_first, reqs_count;
+static unsigned max_in_flight;
+static bool target_echoes_tag;
+
+static int return_code; // -1 if none sent
+static unsigned return_codes_sent;
+
+void send_return_code(unsigned code)
+{
+    return_code = code;
+    return_codes_sent++;
+}
+
+static void send_req(bool write, uint32_t address, uint8_t *value, unsigned len)
+{
+    req_t *req = &reqs[(reqs_first + reqs_count) % MAX_REQS];
+
+    req->write = write;
+    req->address = address;
+    req->len = len;
+    req->tag = target_msg_tag;
+    target_msg_tag = 0; // as UART_send_msg_to_target does
+
+    if (write) // the target applies the write once it gets to it
+        memcpy(&target_mem[address], value, len);
+
+    reqs_count++;
+    if (reqs_count > max_in_flight)
+        max_in_flight = reqs_count;
+}
+
+void target_comm_send_write_mem(uint32_t address, uint8_t *value, unsigned len)
+{
+    send_req(true, address, value, len);
+}
+
+void target_comm_send_read_mem(uint32_t address, unsigned len)
+{
+    send_req(false, address, NULL, len);
+}
+
+#ifdef CONFIG_TARGET_MEM_CACHE
+void mem_cache_invalidate() { }
+#endif
+
+// Answer the oldest request, as the target would
+static bool answer(bool *consumed)
+{
+    static uint8_t data[UART_PKT_MAX_DATA_LEN];
+    uartPkt_t rsp = { 0 };
+    req_t *req;
+
+    if (reqs_count == 0)
+        return false;
+
+    req = &reqs[reqs_first];
+    reqs_first = (reqs_first + 1) % MAX_REQS;
+    reqs_count--;
+
+    rsp.identifier = UART_IDENTIFIER_WISP;
+    rsp.descriptor = WISP_RSP_MEMORY;
+    rsp.seq = target_echoes_tag ? req->tag : 0;
+    rsp.data = data;
+    if (!req->write) {
+        memcpy(data, &target_mem[req->address], req->len);
+        rsp.length = req->len;
+    }
+
+    *consumed = target_xact_complete(&rsp);
+    return true;
+}
+
+static void run_target()
+{
+    bool consumed;
+
+    while (answer(&consumed))
+        CHECK(consumed);
+}
+
+static void reset(bool echo_tag)
+{
+    memset(target_mem, 0, sizeof(target_mem));
+    reqs_first = reqs_count = 0;
+    max_in_flight = 0;
+    target_echoes_tag = echo_tag;
+    return_code = -1;
+    return_codes_sent = 0;
+    late_rsps = 0;
+}
+
+static void make_block(uint8_t *block, unsigned len, uint8_t seed)
+{
+    unsigned i;
+
+    for (i = 0; i < len; ++i)
+        block[i] = seed + i * 7;
+}
+
+// Stage the block in packets of at most pkt_len bytes
+static void stage_block(uint32_t address, const uint8_t *block, unsigned len,
+                        unsigned pkt_len)
+{
+    unsigned offset = pkt_len < len ? pkt_len : len;
+
+    CHECK(mem_write_start(address, len, block, offset) == RETURN_CODE_SUCCESS);
+    while (offset < len) {
+        unsigned n = len - offset < pkt_len ? len - offset : pkt_len;
+        CHECK(mem_write_append(offset, &block[offset], n) == RETURN_CODE_SUCCESS);
+        offset += n;
+    }
+}
+
+static void test_write_verify(bool echo_tag)
+{
+    uint8_t block[CONFIG_MEM_WRITE_STAGING_LEN];
+    const uint32_t address = 0x100;
+
+    reset(echo_tag);
+    make_block(block, sizeof(block), 0x5a);
+
+    // several host packets, then nothing is written until the last one
+    stage_block(address, block, sizeof(block), 100);
+    CHECK(target_xact_pending());
+
+    run_target();
+
+    CHECK(return_codes_sent == 1 && return_code == RETURN_CODE_SUCCESS);
+    CHECK(memcmp(&target_mem[address], block, sizeof(block)) == 0);
+    CHECK(max_in_flight == CONFIG_MEM_WRITE_PIPELINE_DEPTH);
+    CHECK(!target_xact_pending());
+}
+
+static void test_verify_failed()
+{
+    uint8_t block[200];
+    bool consumed;
+
+    reset(true);
+    make_block(block, sizeof(block), 0x11);
+    stage_block(0, block, sizeof(block), sizeof(block));
+
+    // answer the writes, then corrupt a byte before the read back
+    while (reqs_count > 0 && reqs[reqs_first].write)
+        answer(&consumed);
+    target_mem[150] ^= 0xff;
+    run_target();
+
+    CHECK(return_codes_sent == 1 && return_code == RETURN_CODE_VERIFY_FAILED);
+}
+
+static void test_timeout_late_rsps(bool echo_tag)
+{
+    uint8_t block[100];
+    bool consumed;
+
+    reset(echo_tag);
+    make_block(block, sizeof(block), 0x33);
+    stage_block(0, block, sizeof(block), sizeof(block));
+
+    // the target falls silent
+    main_loop_flags |= FLAG_TARGET_XACT_TIMEOUT;
+    target_xact_expire();
+    CHECK(return_codes_sent == 1 && return_code == RETURN_CODE_COMM_ERROR);
+    CHECK(!target_xact_pending());
+
+    // its late responses are dropped, and the next transfer goes through
+    CHECK(mem_write_start(0x200, sizeof(block), block, sizeof(block)) ==
+          RETURN_CODE_SUCCESS);
+    return_codes_sent = 0;
+    while (reqs_count > 0) {
+        answer(&consumed);
+        CHECK(consumed);
+    }
+    CHECK(return_codes_sent == 1 && return_code == RETURN_CODE_SUCCESS);
+    CHECK(memcmp(&target_mem[0x200], block, sizeof(block)) == 0);
+}
+
+static void test_staging_errors()
+{
+    uint8_t block[64];
+
+    reset(true);
+    make_block(block, sizeof(block), 0);
+
+    CHECK(mem_write_start(0, CONFIG_MEM_WRITE_STAGING_LEN + 1, block, 0) ==
+          RETURN_CODE_INVALID_ARGS);
+    CHECK(mem_write_append(0, block, 8) == RETURN_CODE_INVALID_ARGS);
+
+    // out of order: the transfer is dropped
+    CHECK(mem_write_start(0, sizeof(block), block, 16) == RETURN_CODE_SUCCESS);
+    CHECK(mem_write_append(32, &block[32], 16) == RETURN_CODE_INVALID_ARGS);
+    CHECK(mem_write_append(16, &block[16], 16) == RETURN_CODE_INVALID_ARGS);
+
+    // past the end of the block
+    CHECK(mem_write_start(0, sizeof(block), block, 60) == RETURN_CODE_SUCCESS);
+    CHECK(mem_write_append(60, &block[60], 8) == RETURN_CODE_INVALID_ARGS);
+
+    CHECK(reqs_count == 0 && return_codes_sent == 0);
+}
+
+int main()
+{
+    test_write_verify(true);
+    test_write_verify(false);
+    test_verify_failed();
+    test_timeout_late_rsps(true);
+    test_timeout_late_rsps(false);
+    test_staging_errors();
+
+    printf("mem_write_test: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,19 @@
+#ifndef LIBEDB_TARGET_COMM_H
+#define LIBEDB_TARGET_COMM_H
+
+#define UART_IDENTIFIER_WISP 0xF1
+
+#define WISP_CMD_MAX_LEN 16
+
+typedef enum {
+    WISP_RSP_ADDRESS,
+    WISP_RSP_MEMORY,
+    WISP_RSP_SERIAL_ECHO,
+} wisp_rsp_t;
+
+typedef enum {
+    INTERRUPT_TYPE_DEBUGGER_REQ,
+    INTERRUPT_TYPE_TARGET_REQ,
+} interrupt_type_t;
+
+#endif
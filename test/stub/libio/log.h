@@ -0,0 +1,7 @@
+#ifndef LIBIO_LOG_H
+#define LIBIO_LOG_H
+
+#define LOG(...)
+#define PRINTF(...)
+
+#endif
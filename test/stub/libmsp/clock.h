@@ -0,0 +1,8 @@
+#ifndef LIBMSP_CLOCK_H
+#define LIBMSP_CLOCK_H
+
+#define CONFIG_SMCLK_FREQ 24000000
+#define CONFIG_MCLK_FREQ  24000000
+#define CONFIG_ACLK_FREQ  32768
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef LIBMSP_PERIPH_H
+#define LIBMSP_PERIPH_H
+
+#define CONCAT_INNER(a, b) a ## b
+#define CONCAT(a, b) CONCAT_INNER(a, b)
+
+#define BIT_INNER(idx) BIT ## idx
+#define BIT(idx) BIT_INNER(idx)
+
+#define GPIO_INNER(port, reg) P ## port ## reg
+#define GPIO(port, reg) GPIO_INNER(port, reg)
+
+#define UART_INNER(idx, reg) UCA ## idx ## reg
+#define UART(idx, reg) UART_INNER(idx, reg)
+
+#define DMA_INNER(ch, reg) DMA ## ch ## reg
+#define DMA(ch, reg) DMA_INNER(ch, reg)
+#define DMA_CTL_INNER(idx) DMACTL ## idx
+#define DMA_CTL(idx) DMA_CTL_INNER(idx)
+#define DMA_INTFLAG(ch) (((ch) + 1) * 2)
+#define DMA_TRIG(ch, trig) ((trig) << (((ch) % 2) * 8))
+#define DMA_TRIG_UART(idx, dir) (16 + 2 * (idx))
+
+#define TIMER_INNER(t, reg) T ## t ## reg
+#define TIMER(t, reg) TIMER_INNER(t, reg)
+#define TIMER_CC_INNER(t, cc, reg) T ## t ## reg ## cc
+#define TIMER_CC(t, cc, reg) TIMER_CC_INNER(t, cc, reg)
+#define TIMER_DIV_BITS(d) 0
+#define TIMER_A_DIV_EX_BITS(d) 0
+#define TIMER_VECTOR(t, i, cc) 0
+#define TIMER_ISR_INNER(t, i, cc) TIMER ## t ## i ## _ ## cc ## _ISR
+#define TIMER_ISR(t, i, cc) TIMER_ISR_INNER(t, i, cc)
+
+#define BRS_BITS(x) ((x) << 1)
+#define BRF_BITS(x) ((x) << 4)
+
+#define INTFLAG(port, pin) (((pin) + 1) * 2)
+
+#endif
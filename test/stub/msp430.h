@@ -0,0 +1,88 @@
+/**
+ * @file
+ * @brief Host build stand-in for the MSP430 device header
+ * @details Registers are plain variables that the test drives directly.
+ *          A failed ASSERT ends in BLINK_LOOP, which aborts here instead
+ *          of spinning.
+ */
+#ifndef STUB_MSP430_H
+#define STUB_MSP430_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#define REG(name) static volatile uint16_t name __attribute__((unused))
+
+#define __delay_cycles(x) abort()
+#define __disable_interrupt()
+#define __enable_interrupt()
+#define __get_SR_register() ((uint16_t)GIE)
+#define __bis_SR_register(x) ((void)(x))
+#define __bic_SR_register(x) ((void)(x))
+#define __bic_SR_register_on_exit(x)
+#define __even_in_range(x, y) (x)
+#define __no_operation()
+
+#define interrupt(vector) unused
+
+#define GIE 0x0008
+
+#define BIT0 0x0001
+#define BIT1 0x0002
+#define BIT2 0x0004
+#define BIT3 0x0008
+#define BIT4 0x0010
+#define BIT5 0x0020
+#define BIT6 0x0040
+#define BIT7 0x0080
+
+#define DMADT_0         0x0000
+#define DMADT_4         0x4000
+#define DMADSTINCR_3    0x0C00
+#define DMASRCINCR_0    0x0000
+#define DMASRCINCR_3    0x0300
+#define DMADSTINCR_0    0x0000
+#define DMADSTBYTE      0x0080
+#define DMASRCBYTE      0x0040
+#define DMAEN           0x0010
+#define DMAIFG          0x0008
+#define DMAIE           0x0004
+#define DMALEVEL        0x0002
+#define DMARMWDIS       0x0004
+
+#define UCSWRST         0x01
+#define UCSSEL__SMCLK   0x80
+#define UCRXEIE         0x20
+#define UCOS16          0x01
+#define UCRXERR         0x04
+#define UCBUSY          0x01
+#define UCRXIE          0x01
+#define UCTXIE          0x02
+
+#define USCI_NONE       0
+#define USCI_UCRXIFG    2
+#define USCI_UCTXIFG    4
+
+#define TASSEL__ACLK    0x0100
+#define TASSEL__SMCLK   0x0200
+#define MC__CONTINUOUS  0x0020
+#define TACLR           0x0004
+#define CCIE            0x0010
+#define CCIFG           0x0001
+#define LPM3_bits       0x00D0
+
+#define USCI_A0_VECTOR  0
+#define USCI_A1_VECTOR  0
+
+REG(PJOUT); REG(P3SEL); REG(P3DIR); REG(P4OUT); REG(P4SEL); REG(P4DIR);
+REG(DMACTL0); REG(DMACTL1); REG(DMACTL4);
+REG(DMA0CTL); REG(DMA0SA); REG(DMA0DA); REG(DMA0SZ);
+REG(DMA1CTL); REG(DMA1SA); REG(DMA1DA); REG(DMA1SZ);
+REG(DMA2CTL); REG(DMA2SA); REG(DMA2DA); REG(DMA2SZ);
+REG(UCA0CTL1); REG(UCA0BR0); REG(UCA0BR1); REG(UCA0MCTL); REG(UCA0STAT);
+REG(UCA0IE); REG(UCA0IV); REG(UCA0RXBUF); REG(UCA0TXBUF);
+REG(UCA1CTL1); REG(UCA1BR0); REG(UCA1BR1); REG(UCA1MCTL); REG(UCA1STAT);
+REG(TA2CTL); REG(TA2EX0); REG(TA2R); REG(TA2CCR0); REG(TA2CCTL0);
+REG(UCA1IE); REG(UCA1IV); REG(UCA1RXBUF); REG(UCA1TXBUF);
+
+#endif
@@ -0,0 +1,312 @@
+/**
+ * @file
+ * @brief Host build benchmark of parsing host commands out of the RX ring
+ * @details Feeds a stream of random-length commands in chunks and times
+ *          the parser of uart.c against the byte-copy parser it replaced
+ *          (the RX ISR stored each byte into a 65-byte buffer and the main
+ *          loop copied packets out of it byte by byte). In the new path,
+ *          the bytes land in the ring by DMA, so only the parse is timed.
+ *
+ *          Numbers are for the build host, not the MSP430: they compare
+ *          the two code paths, but do not predict cycles on the device.
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "uart.c"
+
+#ifndef BENCH_MSGS
+#define BENCH_MSGS      200000
+#endif
+#define BENCH_CHUNK     UART_BUF_MAX_LEN
+#define BENCH_SEED      0x2545F491u
+
+volatile uint16_t main_loop_flags;
+
+static uint8_t stream[BENCH_MSGS * UART_BUF_MAX_LEN];
+static unsigned stream_len;
+static uint32_t stream_sum; // over payload bytes, to check both parsers
+
+static uint32_t rand_state = BENCH_SEED;
+
+static uint32_t next_rand()
+{
+    rand_state ^= rand_state << 13;
+    rand_state ^= rand_state >> 17;
+    rand_state ^= rand_state << 5;
+    return rand_state;
+}
+
+static void make_stream()
+{
+    unsigned i, j, len;
+
+    for (i = 0; i < BENCH_MSGS; ++i) {
+        len = next_rand() % (UART_PKT_MAX_DATA_LEN + 1);
+        stream[stream_len++] = UART_IDENTIFIER_USB;
+        stream[stream_len++] = USB_CMD_SENSE;
+        stream[stream_len++] = len;
+        stream[stream_len++] = i & 0xff;
+        for (j = 0; j < len; ++j) {
+            stream[stream_len] = next_rand();
+            stream_sum += stream[stream_len++];
+        }
+    }
+}
+
+typedef struct {
+    uint64_t ticks;
+    uint64_t ns;
+} elapsed_t;
+
+typedef struct {
+    uint64_t tsc;
+    struct timespec ts;
+} stamp_t;
+
+static inline void stamp(stamp_t *s)
+{
+    clock_gettime(CLOCK_MONOTONIC, &s->ts);
+#if defined(__x86_64__) || defined(__i386__)
+    s->tsc = __rdtsc();
+#else
+    s->tsc = 0;
+#endif
+}
+
+static inline void add_elapsed(elapsed_t *e, const stamp_t *from)
+{
+    stamp_t to;
+    stamp(&to);
+    e->ticks += to.tsc - from->tsc;
+    e->ns += (to.ts.tv_sec - from->ts.tv_sec) * 1000000000ull +
+             to.ts.tv_nsec - from->ts.tv_nsec;
+}
+
+/*
+ * The parser this tree had before the RX DMA ring, for comparison
+ */
+
+#define BASE_BUF_LEN_WITH_TAIL (UART_BUF_MAX_LEN + 1)
+
+typedef struct {
+    uint8_t buf[BASE_BUF_LEN_WITH_TAIL];
+    unsigned head;
+    unsigned tail;
+} base_buf_t;
+
+typedef struct {
+    uint8_t data[UART_PKT_MAX_DATA_LEN];
+    unsigned identifier;
+    unsigned descriptor;
+    unsigned length;
+    unsigned processed;
+} base_pkt_t;
+
+typedef enum {
+    BASE_STATE_IDENTIFIER,
+    BASE_STATE_DESCRIPTOR,
+    BASE_STATE_DATA_LEN,
+    BASE_STATE_PADDING,
+    BASE_STATE_DATA,
+} base_state_t;
+
+static inline unsigned base_buf_len(base_buf_t *buf)
+{
+    int diff = buf->tail - buf->head;
+    if (diff >= 0)
+        return diff;
+    else
+        return diff + BASE_BUF_LEN_WITH_TAIL;
+}
+
+static void base_rx_int(base_buf_t *buf, uint8_t byte)
+{
+    ASSERT(ASSERT_UART_ERROR_CIRC_BUF_OVERFLOW, buf->tail < BASE_BUF_LEN_WITH_TAIL);
+    buf->buf[buf->tail] = byte;
+    buf->tail = (buf->tail + sizeof(uint8_t)) % BASE_BUF_LEN_WITH_TAIL;
+}
+
+static void base_copy_from(base_buf_t *buf, uint8_t *into, unsigned len)
+{
+    while (len--) {
+        ASSERT(ASSERT_UART_ERROR_CIRC_BUF_OVERFLOW, buf->head < BASE_BUF_LEN_WITH_TAIL);
+        *into++ = buf->buf[buf->head];
+        buf->head = (buf->head + sizeof(uint8_t)) % BASE_BUF_LEN_WITH_TAIL;
+    }
+}
+
+static unsigned base_build_pkt(base_buf_t *buf, base_pkt_t *pkt)
+{
+    static base_state_t state = BASE_STATE_IDENTIFIER;
+    unsigned len;
+    uint8_t byte;
+
+    if (!pkt->processed)
+        return 1;
+
+    len = base_buf_len(buf);
+    while (len > 0) {
+        switch (state) {
+        case BASE_STATE_IDENTIFIER:
+            base_copy_from(buf, &byte, sizeof(uint8_t));
+            pkt->identifier = byte;
+            if (pkt->identifier != UART_IDENTIFIER_USB &&
+                pkt->identifier != UART_IDENTIFIER_WISP) {
+                pkt->processed = 1;
+                state = BASE_STATE_IDENTIFIER;
+                return 1;
+            }
+            len -= sizeof(uint8_t);
+            state = BASE_STATE_DESCRIPTOR;
+            break;
+        case BASE_STATE_DESCRIPTOR:
+            base_copy_from(buf, &byte, sizeof(uint8_t));
+            pkt->descriptor = byte;
+            len -= sizeof(uint8_t);
+            state = BASE_STATE_DATA_LEN;
+            break;
+        case BASE_STATE_DATA_LEN:
+            base_copy_from(buf, &byte, sizeof(uint8_t));
+            pkt->length = byte;
+            len -= sizeof(uint8_t);
+            state = BASE_STATE_PADDING;
+            break;
+        case BASE_STATE_PADDING:
+            base_copy_from(buf, &byte, sizeof(uint8_t));
+            len -= sizeof(uint8_t);
+            if (pkt->length > 0) {
+                state = BASE_STATE_DATA;
+            } else {
+                pkt->processed = 0;
+                state = BASE_STATE_IDENTIFIER;
+                return 0;
+            }
+            break;
+        case BASE_STATE_DATA:
+            if (len >= pkt->length) {
+                if (pkt->length > UART_PKT_MAX_DATA_LEN) {
+                    pkt->processed = 1;
+                    state = BASE_STATE_IDENTIFIER;
+                    return 1;
+                }
+                base_copy_from(buf, pkt->data, pkt->length);
+                pkt->processed = 0;
+                state = BASE_STATE_IDENTIFIER;
+                return 0;
+            } else {
+                return 2;
+            }
+        default:
+            pkt->processed = 1;
+            state = BASE_STATE_IDENTIFIER;
+            return 1;
+        }
+    }
+    return 2;
+}
+
+static void report(const char *name, elapsed_t *e, unsigned msgs, uint32_t sum)
+{
+    printf("%-28s %8.2f ticks/byte %7.2f ns/byte  (%u msgs, %s)\n", name,
+           (double)e->ticks / stream_len, (double)e->ns / stream_len, msgs,
+           sum == stream_sum ? "payload ok" : "PAYLOAD MISMATCH");
+}
+
+static unsigned bench_baseline()
+{
+    static base_buf_t buf;
+    base_pkt_t pkt = { .processed = 1 };
+    elapsed_t isr = { 0 }, parse = { 0 };
+    unsigned pos = 0, msgs = 0, i;
+    uint32_t sum = 0;
+    stamp_t t;
+
+    while (pos < stream_len) {
+        stamp(&t);
+        while (pos < stream_len && base_buf_len(&buf) < UART_BUF_MAX_LEN)
+            base_rx_int(&buf, stream[pos++]);
+        add_elapsed(&isr, &t);
+
+        stamp(&t);
+        while (base_build_pkt(&buf, &pkt) != 2) {
+            if (!pkt.processed) {
+                for (i = 0; i < pkt.length; ++i)
+                    sum += pkt.data[i];
+                pkt.processed = 1;
+                msgs++;
+            }
+        }
+        add_elapsed(&parse, &t);
+    }
+
+    report("baseline: RX ISR stores", &isr, msgs, sum);
+    report("baseline: parse", &parse, msgs, sum);
+    return msgs == BENCH_MSGS && sum == stream_sum;
+}
+
+// Write bytes into the ring where the RX DMA channel would
+static void dma_receive(const uint8_t *bytes, unsigned len)
+{
+    unsigned pos = UART_HOST_RX_RING_SIZE - DMA(DMA_HOST_UART_RX, SZ);
+
+    while (len--) {
+        usbRxStorage[pos++] = *bytes++;
+        if (pos == UART_HOST_RX_RING_SIZE) {
+            pos = 0;
+            UART_host_rx_wrapped();
+        }
+    }
+    DMA(DMA_HOST_UART_RX, SZ) = UART_HOST_RX_RING_SIZE - pos;
+}
+
+static unsigned bench_ring()
+{
+    elapsed_t parse = { 0 };
+    unsigned pos = 0, msgs = 0, len, i;
+    uint32_t sum = 0;
+    uartPkt_t *pkt;
+    stamp_t t;
+
+    UART_setup(UART_INTERFACE_USB);
+    DMA(DMA_HOST_UART_RX, SZ) = UART_HOST_RX_RING_SIZE;
+
+    while (pos < stream_len) {
+        len = stream_len - pos < BENCH_CHUNK ? stream_len - pos : BENCH_CHUNK;
+        dma_receive(&stream[pos], len);
+        pos += len;
+
+        stamp(&t);
+        while ((pkt = UART_next_host_cmd())) {
+            for (i = 0; i < pkt->length; ++i)
+                sum += pkt->data[i];
+            pkt->processed = 1;
+            msgs++;
+        }
+        add_elapsed(&parse, &t);
+    }
+
+    report("ring: parse in place", &parse, msgs, sum);
+    printf("ring: overruns %u, resyncs %u\n",
+           host_link_stats.rx_overruns, host_link_stats.resyncs);
+    return msgs == BENCH_MSGS && sum == stream_sum &&
+           host_link_stats.rx_overruns == 0;
+}
+
+int main()
+{
+    unsigned ok;
+
+    make_stream();
+    printf("%u msgs, %u bytes, fed in chunks of %u bytes\n",
+           BENCH_MSGS, stream_len, BENCH_CHUNK);
+
+    ok = bench_baseline();
+    ok &= bench_ring();
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,378 @@
+/**
+ * @file
+ * @brief Host build tests of parsing host commands out of the RX ring
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "uart.c"
+
+volatile uint16_t main_loop_flags;
+
+static unsigned failures = 0;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%u: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            failures++; \
+        } \
+    } while (0)
+
+// Write bytes into the ring where the RX DMA channel would
+static void dma_receive(const uint8_t *bytes, unsigned len)
+{
+    unsigned pos = UART_HOST_RX_RING_SIZE - DMA(DMA_HOST_UART_RX, SZ);
+
+    while (len--) {
+        usbRxStorage[pos++] = *bytes++;
+        if (pos == UART_HOST_RX_RING_SIZE) {
+            pos = 0;
+            UART_host_rx_wrapped();
+        }
+    }
+    DMA(DMA_HOST_UART_RX, SZ) = UART_HOST_RX_RING_SIZE - pos;
+}
+
+static void receive_cmd(unsigned descriptor, unsigned len, uint8_t fill)
+{
+    uint8_t msg[UART_BUF_MAX_LEN];
+
+    msg[0] = UART_IDENTIFIER_USB;
+    msg[1] = descriptor;
+    msg[2] = len;
+    msg[3] = 0;
+    memset(&msg[UART_MSG_HEADER_SIZE], fill, len);
+    dma_receive(msg, UART_MSG_HEADER_SIZE + len);
+}
+
+// Message with the extended header (HOST_LINK_EXT_LEN)
+static void receive_ext_cmd(unsigned descriptor, unsigned len, uint8_t fill)
+{
+    uint8_t msg[UART_MSG_EXT_HEADER_SIZE + 256];
+
+    msg[0] = UART_IDENTIFIER_USB;
+    msg[1] = descriptor;
+    msg[2] = len & 0xff;
+    msg[3] = 0;
+    msg[4] = len >> 8;
+    msg[5] = 0;
+    memset(&msg[UART_MSG_EXT_HEADER_SIZE], fill, len);
+    dma_receive(msg, UART_MSG_EXT_HEADER_SIZE + len);
+}
+
+#ifdef CONFIG_HOST_UART_FRAMING
+// Framed message (HOST_LINK_FRAMED), with the CRC off by crc_xor
+static void receive_frame(unsigned descriptor, unsigned len, uint8_t fill,
+                          uint16_t crc_xor)
+{
+    uint8_t msg[UART_MSG_HEADER_SIZE + UART_FRAME_CRC_SIZE + 256];
+    uint8_t frame[UART_FRAME_ENCODED_LEN(UART_MSG_HEADER_SIZE + 256)];
+    cobs_encoder_t enc;
+    unsigned msg_len = UART_MSG_HEADER_SIZE + len;
+    unsigned frame_len, i;
+    uint16_t crc;
+
+    msg[0] = UART_IDENTIFIER_USB;
+    msg[1] = descriptor;
+    msg[2] = len;
+    msg[3] = 0;
+    memset(&msg[UART_MSG_HEADER_SIZE], fill, len);
+    crc = crc16_update(CRC16_INIT, msg, msg_len) ^ crc_xor;
+    msg[msg_len++] = crc & 0xff;
+    msg[msg_len++] = crc >> 8;
+
+    cobs_begin(&enc, frame);
+    for (i = 0; i < msg_len; ++i)
+        cobs_put(&enc, msg[i]);
+    frame_len = cobs_end(&enc);
+    dma_receive(frame, frame_len);
+}
+#endif // CONFIG_HOST_UART_FRAMING
+
+static void reset()
+{
+    UART_set_host_link(0);
+    memset(&host_link_stats, 0, sizeof(host_link_stats));
+    host_cmds_first = 0;
+    host_cmds_count = 0;
+    host_cmds_issued = 0;
+    UART_setup(UART_INTERFACE_USB);
+    DMA(DMA_HOST_UART_RX, SZ) = UART_HOST_RX_RING_SIZE;
+}
+
+static void test_cmds_across_wrap()
+{
+    uartPkt_t *pkt;
+    unsigned i;
+
+    reset();
+
+    // several times around the ring, processing as received
+    for (i = 0; i < 3 * UART_HOST_RX_RING_SIZE / 16; ++i) {
+        receive_cmd(USB_CMD_SENSE, 12, i);
+        pkt = UART_next_host_cmd();
+        CHECK(pkt != NULL);
+        if (!pkt)
+            return;
+        CHECK(pkt->length == 12);
+        CHECK(pkt->data[0] == (uint8_t)i && pkt->data[11] == (uint8_t)i);
+        pkt->processed = 1;
+    }
+
+    CHECK(UART_next_host_cmd() == NULL);
+    CHECK(host_link_stats.rx_overruns == 0);
+}
+
+static void test_overrun_resync()
+{
+    uint8_t flood[UART_HOST_RX_RING_SIZE + 32];
+    uartPkt_t *pkt, *held;
+
+    reset();
+
+    receive_cmd(USB_CMD_SENSE, 4, 0x11);
+    held = UART_next_host_cmd();
+    CHECK(held != NULL);
+
+    // more than the ring holds, without the parser keeping up
+    memset(flood, 0, sizeof(flood));
+    dma_receive(flood, sizeof(flood));
+
+    CHECK(UART_next_host_cmd() == NULL);
+    CHECK(host_link_stats.rx_overruns == 1);
+
+    // once the host paces itself, commands get through again
+    held->processed = 1;
+    receive_cmd(USB_CMD_SENSE, 8, 0x22);
+    pkt = UART_next_host_cmd();
+    CHECK(pkt != NULL);
+    if (pkt) {
+        CHECK(pkt->length == 8 && pkt->data[7] == 0x22);
+        pkt->processed = 1;
+    }
+    CHECK(host_link_stats.rx_overruns == 1);
+}
+
+static void test_ext_len_cmds()
+{
+    const unsigned max_data_len = UART_HOST_RX_MSG_MAX_LEN - UART_MSG_EXT_HEADER_SIZE;
+    uartPkt_t *pkt;
+    unsigned i;
+
+    reset();
+    UART_set_host_link(HOST_LINK_EXT_LEN);
+
+    // longer than UART_BUF_MAX_LEN; the third one wraps around the ring end
+    for (i = 0; i < 3; ++i) {
+        receive_ext_cmd(USB_CMD_SENSE, 100, 0x30 + i);
+        pkt = UART_next_host_cmd();
+        CHECK(pkt != NULL);
+        if (!pkt)
+            return;
+        CHECK(pkt->length == 100);
+        CHECK(pkt->data[0] == 0x30 + i && pkt->data[99] == 0x30 + i);
+        pkt->processed = 1;
+    }
+
+    receive_ext_cmd(USB_CMD_SENSE, max_data_len, 0x40);
+    pkt = UART_next_host_cmd();
+    CHECK(pkt != NULL);
+    if (pkt) {
+        CHECK(pkt->length == max_data_len && pkt->data[max_data_len - 1] == 0x40);
+        pkt->processed = 1;
+    }
+
+    // over the limit: dropped, and the next command still gets through
+    receive_ext_cmd(USB_CMD_SENSE, max_data_len + 1, 0);
+    receive_ext_cmd(USB_CMD_SENSE, 2, 0x50);
+    pkt = UART_next_host_cmd();
+    CHECK(pkt != NULL);
+    if (pkt) {
+        CHECK(pkt->length == 2 && pkt->data[1] == 0x50);
+        pkt->processed = 1;
+    }
+    CHECK(UART_next_host_cmd() == NULL);
+    CHECK(host_link_stats.rx_overruns == 0);
+}
+
+static void test_peek_cmd()
+{
+    uartPkt_t *pkt;
+
+    reset();
+    CHECK(UART_peek_host_cmd() == NULL);
+
+    // a held command stays next, and is not released
+    receive_cmd(USB_CMD_SENSE, 4, 0x61);
+    receive_cmd(USB_CMD_SENSE, 4, 0x62);
+    pkt = UART_peek_host_cmd();
+    CHECK(pkt != NULL && pkt->data[0] == 0x61);
+    CHECK(UART_peek_host_cmd() == pkt);
+
+    CHECK(UART_next_host_cmd() == pkt);
+    pkt->processed = 1;
+    pkt = UART_peek_host_cmd();
+    CHECK(pkt != NULL && pkt->data[0] == 0x62);
+    CHECK(UART_next_host_cmd() == pkt);
+    if (pkt)
+        pkt->processed = 1;
+    CHECK(UART_next_host_cmd() == NULL);
+}
+
+#ifdef CONFIG_HOST_UART_FRAMING
+// Encode, check the frame is free of zeros but for the delimiter, decode
+static void check_cobs_round_trip(const uint8_t *data, unsigned len)
+{
+    uint8_t frame[UART_FRAME_ENCODED_LEN(300)];
+    cobs_encoder_t enc;
+    unsigned frame_len, i;
+
+    cobs_begin(&enc, frame);
+    for (i = 0; i < len; ++i)
+        cobs_put(&enc, data[i]);
+    frame_len = cobs_end(&enc);
+
+    CHECK(frame_len <= UART_FRAME_ENCODED_LEN(len));
+    CHECK(frame[frame_len - 1] == 0);
+    CHECK(memchr(frame, 0, frame_len - 1) == NULL);
+    CHECK(cobs_decode(frame, frame_len - 1) == len);
+    CHECK(memcmp(frame, data, len) == 0);
+}
+
+static void test_cobs_round_trip()
+{
+    uint8_t data[300];
+    unsigned i;
+
+    // longer than a block, with no zero to end it
+    for (i = 0; i < sizeof(data); ++i)
+        data[i] = 1 + i % 255;
+    check_cobs_round_trip(data, sizeof(data));
+    check_cobs_round_trip(data, 254);
+    check_cobs_round_trip(data, 255);
+
+    // zeros at both ends, back to back, and right after a full block
+    for (i = 0; i < sizeof(data); ++i)
+        data[i] = (i % 37 == 0) ? 0 : i;
+    data[1] = 0;
+    data[255] = 0;
+    data[sizeof(data) - 1] = 0;
+    check_cobs_round_trip(data, sizeof(data));
+
+    memset(data, 0, sizeof(data));
+    check_cobs_round_trip(data, 3);
+    check_cobs_round_trip(data, 0);
+}
+
+static void test_framed_cmds()
+{
+    uint8_t junk[UART_HOST_RX_FRAME_MAX_LEN + 8];
+    uint8_t delimiter = 0;
+    uartPkt_t *pkt;
+    unsigned i;
+
+    reset();
+    UART_set_host_link(HOST_LINK_FRAMED);
+
+    // zeros in the data; the third one wraps around the ring end
+    for (i = 0; i < 3; ++i) {
+        receive_frame(USB_CMD_SENSE, 100, i, 0);
+        pkt = UART_next_host_cmd();
+        CHECK(pkt != NULL);
+        if (!pkt)
+            return;
+        CHECK(pkt->length == 100);
+        CHECK(pkt->data[0] == i && pkt->data[99] == i);
+        pkt->processed = 1;
+    }
+    CHECK(host_link_stats.rx_msgs == 3);
+
+    // corrupted CRC: dropped, and the next frame still gets through
+    receive_frame(USB_CMD_SENSE, 4, 0x11, 0x0100);
+    receive_frame(USB_CMD_SENSE, 4, 0x22, 0);
+    pkt = UART_next_host_cmd();
+    CHECK(pkt != NULL);
+    if (pkt) {
+        CHECK(pkt->length == 4 && pkt->data[3] == 0x22);
+        pkt->processed = 1;
+    }
+    CHECK(host_link_stats.crc_errors == 1);
+
+    // not a message once decoded: a framing error
+    junk[0] = 0x7f;
+    junk[1] = 0x7f;
+    dma_receive(junk, 2);
+    dma_receive(&delimiter, 1);
+    CHECK(UART_next_host_cmd() == NULL);
+    CHECK(host_link_stats.framing_errors == 1);
+
+    // no delimiter within the longest frame: skipped to resync
+    memset(junk, 0x55, sizeof(junk));
+    dma_receive(junk, sizeof(junk));
+    CHECK(UART_next_host_cmd() == NULL);
+    CHECK(host_link_stats.resyncs == 1);
+    dma_receive(&delimiter, 1);
+    receive_frame(USB_CMD_SENSE, 8, 0x33, 0);
+    pkt = UART_next_host_cmd();
+    CHECK(pkt != NULL);
+    if (pkt) {
+        CHECK(pkt->length == 8 && pkt->data[7] == 0x33);
+        pkt->processed = 1;
+    }
+
+    CHECK(UART_next_host_cmd() == NULL);
+    CHECK(host_link_stats.rx_msgs == 5);
+    CHECK(host_link_stats.crc_errors == 1);
+    CHECK(host_link_stats.framing_errors == 1);
+    CHECK(host_link_stats.resyncs == 1);
+    CHECK(host_link_stats.rx_overruns == 0);
+}
+
+static void test_framed_partial()
+{
+    uint8_t frame[UART_FRAME_ENCODED_LEN(UART_MSG_HEADER_SIZE + 16)];
+    unsigned frame_len, pos;
+    uartPkt_t *pkt;
+
+    reset();
+    UART_set_host_link(HOST_LINK_FRAMED);
+
+    // capture an encoded frame, then feed it back a few bytes at a time
+    receive_frame(USB_CMD_SENSE, 16, 0x44, 0);
+    frame_len = UART_HOST_RX_RING_SIZE - DMA(DMA_HOST_UART_RX, SZ);
+    memcpy(frame, usbRxStorage, frame_len);
+    reset();
+    UART_set_host_link(HOST_LINK_FRAMED);
+
+    // nothing is issued until the delimiter arrives
+    for (pos = 0; pos + 5 < frame_len; pos += 5) {
+        dma_receive(&frame[pos], 5);
+        CHECK(UART_next_host_cmd() == NULL);
+    }
+    dma_receive(&frame[pos], frame_len - pos);
+    pkt = UART_next_host_cmd();
+    CHECK(pkt != NULL);
+    if (pkt) {
+        CHECK(pkt->length == 16 && pkt->data[15] == 0x44);
+        pkt->processed = 1;
+    }
+    CHECK(host_link_stats.resyncs == 0 && host_link_stats.framing_errors == 0);
+}
+#endif // CONFIG_HOST_UART_FRAMING
+
+int main()
+{
+    test_cmds_across_wrap();
+    test_overrun_resync();
+    test_ext_len_cmds();
+    test_peek_cmd();
+#ifdef CONFIG_HOST_UART_FRAMING
+    test_cobs_round_trip();
+    test_framed_cmds();
+    test_framed_partial();
+#endif
+
+    printf("uart_test: %s\n", failures ? "FAILED" : "ok");
+    return failures ? 1 : 0;
+}